@@ -0,0 +1,138 @@
+#include "config.h"
+#include "dpad.h"
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+config_t EEMEM ee_config[CONFIG_SLOTS];
+
+config_t cfg;
+
+typedef char config_size_check[(sizeof(config_t) == CONFIG_SIZE) ? 1 : -1]; // descriptor must match struct
+
+// current slot and background EEPROM write:
+	uchar cfg_slot = CONFIG_SLOTS - 1; // so first save goes to slot 0
+	uchar ee_wr_cnt = 0; // bytes left to write
+	uchar *ee_wr_ptr;
+
+// feature report transfer:
+	config_t cfg_rx; // SET_FEATURE data, "cfg" change only after full valid block
+	uchar cfg_pos;
+	uchar cfg_len;
+
+static uchar configCrc(const config_t *c)
+{
+	uchar crc = 0;
+	const uchar *ptr = (const uchar *)c;
+
+	for(uchar i = 0; i < CONFIG_SIZE - 1; i++) crc = _crc_ibutton_update(crc, ptr[i]);
+	return crc;
+}
+
+static uchar configValid(const config_t *c) // timer values come from host or EEPROM of other firmware: check limits of "timing.h"
+{
+	if(c -> version != CONFIG_VERSION) return 0;
+	
+	if(c -> per_poll_gp_us < PER_POLL_GP_MIN_US) return 0; // too short: SEL front late by pass of main loop, 16 bit field always fits ticks (SEL_MAX_US)
+	if(c -> delay_btw_poll_us <= SEL_RESET_US) return 0; // pad counter must reset
+	if((c -> spi_div_log2 < 1) | (c -> spi_div_log2 > 7)) return 0;
+	
+	return c -> dpad_mode < DPAD_MODES;
+}
+
+static void configDefault()
+{
+	cfg.version = CONFIG_VERSION;
+	cfg.seq = 0;
+	cfg.delay_idle = INIT_IDLE_TIME;
+	cfg.per_poll_gp_us = PER_POLL_GP_US;
+	cfg.delay_btw_poll_us = DELAY_BTW_POLL_US;
+	cfg.spi_div_log2 = SPI_DIV_LOG2;
+
+	for(uchar i = 0; i < REMAP_BTN; i++) cfg.remap[i] = i;
+	cfg.dpad_mode = DPAD_MODE_INIT;
+}
+
+void configLoad()
+{
+	config_t temp;
+	uchar found = 0;
+
+	configDefault();
+
+	for(uchar i = 0; i < CONFIG_SLOTS; i++)
+	{
+		eeprom_read_block(&temp, &ee_config[i], CONFIG_SIZE);
+
+		if(!configValid(&temp) | (temp.crc != configCrc(&temp))) continue; // erased or torn slot
+
+		if(!found | ((signed char)(temp.seq - cfg.seq) > 0))
+		{
+			cfg = temp;
+			cfg_slot = i;
+			found = 1;
+		}
+	}
+}
+
+void configSave()
+{
+	cfg.seq++;
+	cfg.crc = configCrc(&cfg);
+
+	if(++cfg_slot >= CONFIG_SLOTS) cfg_slot = 0;
+
+	ee_wr_ptr = (uchar *)&cfg;
+	ee_wr_cnt = CONFIG_SIZE; // "crc" is last byte: slot is invalid until whole block is written
+}
+
+void configPoll()
+{
+	if(ee_wr_cnt == 0) return;
+	if(!eeprom_is_ready()) return; // ~3.4 ms per byte
+
+	uchar i = CONFIG_SIZE - ee_wr_cnt;
+
+	eeprom_update_byte((uchar *)&ee_config[cfg_slot] + i, ee_wr_ptr[i]);
+	ee_wr_cnt--;
+}
+
+usbMsgLen_t configSetup(usbRequest_t *rq)
+{
+	cfg_pos = 0;
+	cfg_len = CONFIG_SIZE;
+
+	if(rq -> wLength.word < cfg_len) cfg_len = rq -> wLength.word;
+
+	return USB_NO_MSG; // call "usbFunctionRead" or "usbFunctionWrite"
+}
+
+uchar configRead(uchar *data, uchar len)
+{
+	const uchar *ptr = (const uchar *)&cfg;
+
+	if(len > cfg_len - cfg_pos) len = cfg_len - cfg_pos;
+
+	for(uchar i = 0; i < len; i++) data[i] = ptr[cfg_pos++];
+	return len;
+}
+
+uchar configWrite(uchar *data, uchar len)
+{
+	uchar *ptr = (uchar *)&cfg_rx;
+
+	if(len > cfg_len - cfg_pos) len = cfg_len - cfg_pos;
+
+	for(uchar i = 0; i < len; i++) ptr[cfg_pos++] = data[i];
+
+	if(cfg_pos < cfg_len) return 0; // wait next chunk
+
+	if((cfg_len != CONFIG_SIZE) | !configValid(&cfg_rx)) return 0xFF;
+	if(ee_wr_cnt != 0) return 0xFF; // previous block is not saved yet, host must repeat
+
+	cfg_rx.seq = cfg.seq;
+	cfg = cfg_rx;
+
+	configSave();
+	return 1;
+}
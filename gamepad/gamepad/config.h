@@ -0,0 +1,56 @@
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include "defines.h"
+#include "remap.h"
+
+#include <stdint.h>
+
+#include "usbdrv/usbdrv.h"
+
+#define CONFIG_VERSION	3
+#define CONFIG_SLOTS	8	/* wear-leveling: config write goes to next slot in EEPROM by circle */
+
+// HID report type in high byte of "wValue" for GET/SET_REPORT:
+	#define HID_REPORT_INPUT	1
+	#define HID_REPORT_OUTPUT	2
+	#define HID_REPORT_FEATURE	3
+
+/*********************************************************************************/
+/* config block - feature report of gamepad (GET/SET_FEATURE), the same bytes    */
+/* lie in EEPROM slot, "seq" and "crc" fill by MC (host values are ignored)      */
+/* newest slot - valid slot with max "seq" (in circle of 256)                     */
+/* durations are in us, not in timer counts: block does not depend on F_CPU,     */
+/* values out of limits of "timing.h" are rejected (SET_FEATURE is stalled)      */
+/*********************************************************************************/
+
+typedef struct
+{
+	uchar version;			/* must be CONFIG_VERSION in SET_FEATURE, else request stalled */
+	uchar seq;
+	uint16_t per_poll_gp_us;	/* SEGA: PER_POLL_GP_MIN_US..SEL_MAX_US, see PER_POLL_GP_US */
+	uint16_t delay_btw_poll_us;	/* SEGA: above SEL_RESET_US..SEL_MAX_US, see DELAY_BTW_POLL_US */
+	uchar delay_idle;		/* USB idle time in steps of 4 ms */
+	uchar spi_div_log2;		/* PS: SCK = F_CPU / 2^"spi_div_log2", 1..7 */
+	uchar remap[REMAP_BTN];	/* see "remap.h" */
+	uchar dpad_mode;		/* SOCD cleaning: DPAD_MODE_*, see "dpad.h" */
+	uchar crc;
+} config_t;
+
+#define CONFIG_SIZE 26 /* sizeof(config_t): it's used in report descriptor */
+
+extern config_t cfg;
+
+void configLoad(); // newest valid slot from EEPROM or defaults from "defines.h"
+void configSave(); // start write "cfg" to next slot, writing goes byte by byte in "configPoll"
+void configPoll(); // call from main loop: do not block USB while EEPROM is writing
+
+// feature report transfer, call from "usbFunctionSetup/Read/Write":
+	usbMsgLen_t configSetup(usbRequest_t *rq);
+	uchar configRead(uchar *data, uchar len);
+	uchar configWrite(uchar *data, uchar len); // 1 - block is complete and saved in "cfg", 0xFF - bad block or value out of limits
+
+// define in firmware: apply "cfg" to hardware and vars
+	void configApply();
+
+#endif /* CONFIG_H_ */
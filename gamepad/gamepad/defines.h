@@ -1,6 +1,6 @@
 #define F_CPU 16000000L
 
-#define DEBUG
+#define DEBUG /* raw controller frames are streamed on USART (STREAM), USB works as usual */
 //#define DEBUG_SEGA
 //#define DEBUG_PS
 
@@ -8,14 +8,42 @@
 	#undef DEBUG_PS
 #endif
 
-#define REPORT_SIZE 6
+#define PLAYERS 2 /* composite device: one HID interface per player, EP1 and EP3 */
 
-#define STEP_IDLE_CONF	250	/* 4 ms step for calculate idle time in cnt of timer 0 with presc */
-#define INIT_IDLE_TIME	4	/* 100 <=> 400 ms in cnt of timer 0 */
+//#define REPORT_STAMP /* add to report vendor fields: sequence number of controller frame, timer 1 stamp and SOF count */
+						/* of sample, to fit 8 byte packet Rx, Ry are removed (see "report_fields.h") */
+
+#define STICKY_PRESS /* press seen in any sample since last sent report stays in report until it is sent (see "history.h") */
+//#define HISTORY /* RAM ring of last button changes and sent reports, read by VENDOR_RQ_HISTORY */
+	#define HISTORY_RECORDS	16 /* power of 2, 5 bytes each */
+
+//#define DPAD_HAT /* hat switch field in report from cleaned directions (see "dpad.h"), not with REPORT_STAMP: 9 bytes */
+#define DPAD_MODE_INIT 0 /* SOCD cleaning, DPAD_MODE_NONE (see "dpad.h"), host changes it in config block */
+
+// layout of report, REPORT_SIZE and descriptor are generated from field table in "report_fields.h" (included at the end)
+#define REPORT_AXIS_NEUTRAL 0x7F /* stick value in report when controller is absent */
+
+// all durations in us, timer constants are derived from F_CPU in "timing.h" (included at the end)
+#define STEP_IDLE_US	4000	/* 4 ms step for calculate idle time (HID idle unit) */
+#define INIT_IDLE_TIME	4		/* 100 <=> 400 ms in steps of STEP_IDLE_US */
+
+// cyclic executive of main loop (see "sched.h"): periods of slots and declared worst cases in us
+	#define SCHED_USB_GAP_US	5000	/* longest time between "usbPoll" calls (V-USB: somewhat less than 50 ms), checked */
+	#define SCHED_USB_WCET_US	100		/* every pass: "usbPoll" (~ 10 us) with SETUP or packet of card sector (no wait for card), reports to both endpoints (~ 32 us each) */
+	#define SCHED_MC_WCET_US	100		/* main.c: byte of memory card in every pass while transfer goes (~ 90 us), the only card work of pass */
+	#define SCHED_POLL_US		1000	/* main.c: PS / SNES poll and report build, once per USB frame */
+	#define SCHED_HOUSE_US		1000	/* background EEPROM write of config: byte per ~ 3.4 ms */
+	#define SCHED_IDLE_WCET_US	5		/* idle step (STEP_IDLE_US period) */
+	#define SCHED_HOUSE_WCET_US	20
+	#define SCHED_BUILD_WCET_US	200		/* main.c: check and build of reports from PS frame, multitap - 4 slots */
+
+// presence of controllers (see "presence.h"):
+	#define PROBE_BACKOFF_MAX	5		/* absent port is probed up to 2^5 times rarer than base period */
+	#define PS_PROBE_US			2000	/* PS: base probe period of absent port => hotplug is found in 64 ms */
 
 // for descriptors:
 	#define UNUSED 0x00
-	#define TOTAL_LEN_DESCR (9 + 9 + 9 + 7)
+	#define TOTAL_LEN_DESCR (9 + PLAYERS * (9 + 9 + 7)) /* config + (interface + HID + endpoint) per player */
 
 // LED:
 	#define PORT_LED PORTD
@@ -77,10 +105,21 @@
 #define SEGA_PIN_MASK 0b00111111	/* e.g. if SEGA buttons PIN match "PORTB 0..6" => MASK = 0b00111111, */
 									/* because last 2 bits on PORTB - TOSC 1,2 */
 
-#define PER_POLL_GP		30	/* period of SEL signal for gamepad in cnt of timer 2 with presc */
-#define DELAY_BTW_POLL	255	/* delay between packets 0..7 of SEL signal in cnt of timer 2 with presc, */
-							/* for reset internal cnt in gamepad (minimum required 1.6 ms) */
-#define DELAY_BEF_POLL	10	/* delay after front of SEL signal (before polling buttons) in cnt of timer 2 with presc */
+#define PER_POLL_GP_US		248		/* half period of SEL signal for gamepad */
+#define DELAY_BTW_POLL_US	2048	/* delay between packets 0..7 of SEL signal, */
+									/* for reset internal cnt in gamepad (minimum required 1.6 ms) */
+#define DELAY_BEF_POLL_US	80		/* buttons settle after front of SEL signal: state is sampled right before next front */
+#define PER_POLL_GP_MIN_US	208		/* lower limit of "per_poll_gp_us" in config: front late by pass of main loop leaves DELAY_BEF_POLL_US */
+#define SEL_WAIT_STEP_US	120		/* delay between packets is checked this often (SEL slot): wake by pin change is seen this late */
+#define SCHED_SEL_WCET_US	10		/* sega_only.c: sample of both ports and SEL front, or check of delay */
+
+#define SEGA_PCINT /* sega_only.c: change of data lines while SEL is low between packets starts next packet at once */
+	#define SEL_RESET_US		1600	/* 6 button pad resets its counter after this time with steady SEL */
+	#define SEGA_IDLE_BACKOFF	0		/* no change in packets: next ones go up to 2^n times rarer, change wakes them; */
+										/* only UP, DW, A, ST wake by PCINT: other buttons would wait for rare packet */
+
+//#define SATURN_PAD /* sega_only.c: Saturn digital pad through adapter on any port, found automatically (see "saturnRead") */
+	#define SATURN_SETTLE_US	3	/* after TH/TR change before nibble is read */
 
 /************************************************************************************************************************/
 /*                                                         PS:                                                          */
@@ -98,4 +137,97 @@
 	
 	//#define PS_ACK	4 /* Pin 9: acknowledge, must be pullup to 3.3 or 5 V through 1kOhm */
 	
-#define SPI_FROZE 10000 /* in tact, while wait SPI ready anti frozen counter */
\ No newline at end of file
+#define PS_SCK_HZ 160000L /* max SCK of hardware SPI: 16 MHz / 128 = 125 kHz, 20 MHz / 128 = 156 kHz */
+
+// transport of PS in main.c (bit-banged one is firmware "psone_only.c"):
+	#define PS_ENGINE_SPI	0 /* hardware SPI: MISO, MOSI, CLK on PORT_PS */
+	#define PS_ENGINE_USART	1 /* USART in master SPI mode: MISO - RXD (PD0), MOSI - TXD (PD1), CLK - XCK (PD4, */
+							  /* the same pin as CTRL: it is read once on start), CS stays PS_CS */
+	
+	#define PS_ENGINE PS_ENGINE_SPI
+
+#define PS_MULTITAP /* SCPH-1070: 4 slots in one frame, first PLAYERS occupied slots go to players */
+#define PS_MEMCARD /* memory card read and write by vendor requests (see "memcard.h"), V-USB long transfers */
+//#define PS_MOUSE /* 2nd interface (EP3) is HID mouse for PS mouse on port or multitap slot, PS pads - only 1st player */
+
+#ifdef PS_MOUSE
+	#define PS_PAD_PLAYERS	(PLAYERS - 1)
+	#define MOUSE_IFACE		1
+#else
+	#define PS_PAD_PLAYERS	PLAYERS
+#endif
+
+#define PS_FRAME_LEN	9					/* 0xFF, ID, 0x5A, 6 data bytes */
+#define PS_TAP_SLOTS	4
+#define PS_TAP_FRAME_LEN	(3 + PS_TAP_SLOTS * 8)	/* 0xFF, 0x80, 0x5A, per slot: ID, 0x5A, 6 data bytes */
+
+#ifdef PS_MULTITAP
+	#define PS_FRAME_MAX	PS_TAP_FRAME_LEN
+	#define PS_CMD_TAP		0x01 /* 3rd command byte: multitap sends all slots, pad ignores it */
+	#define PS_SLOT_FREE	0xFF /* slot is not bound to player */
+	#define PS_SLOT_MOUSE	0xFE /* slot is bound to mouse interface (PS_MOUSE) */
+#else
+	#define PS_FRAME_MAX	PS_FRAME_LEN
+	#define PS_CMD_TAP		0xFF
+#endif
+
+// bit-banged PS (psone_only.c):
+	#define CLK_HALF_PER_US		70	/* PS CLK ~ 7 kHz: period of EDGE slot, late edge only stretches CLK */
+	#define SCHED_EDGE_WCET_US	10	/* one CLK edge with MOSI, MISO and CS */
+
+#define SPI_FROZE 10000 /* in tact, while wait SPI ready anti frozen counter */
+
+// validation of PS frame (see "psCheckFrame"):
+	#define PS_RETRY_MAX_US	1500	/* bad frame is read again at once while this time from 1st try is not over, */
+								/* less at slow clock with multitap: see PS_RETRY_US in "timing.h" */
+	#define PS_HOLD_MAX	16		/* polls in a row with bad frames and last good report held, then port is absent */
+
+/************************************************************************************************************************/
+/*                                      SNES / NES pads on PS port (main.c only)                                       */
+/************************************************************************************************************************/
+
+//#define SNES_PAD /* two SNES or NES pads instead of PS: shift registers are read by hardware SPI, one pad per player */
+
+// wiring: "CLOCK" of both pads - PS_CLK (SCK), "LATCH" of 1st pad - PS_CS, of 2nd - SNES_LATCH2 (separate lines),
+// "DATA" of both pads - PS_MISO through Schottky diodes (anode to pad) with 10 kOhm pull down on MISO: pad that is
+// not read now has shifted out all its bits and gives "0" of grounded serial input, so wired OR shows only pad
+// being latched; absent pad reads "0" in bits that SNES pad always gives "1"
+	#define SNES_LATCH2		1 /* PB1 */
+	
+	#define SNES_DATA_LEN		2	/* SNES - 16 bits (12 buttons and 4 bits of "1"), NES - 8 bits, then "0" */
+	#define SNES_LATCH_US		2	/* latch pulse: CD4021 needs ~ 0.2 us, 12 us of console is not required */
+	#define SNES_SPI_DIV_LOG2	4	/* SCK = F_CPU / 16 = 1 MHz: both bytes in ~ 16 us, config speed is for PS */
+
+#ifdef SNES_PAD
+	#if PS_ENGINE != PS_ENGINE_SPI
+		#error "SNES_PAD uses hardware SPI: set PS_ENGINE_SPI"
+	#endif
+	
+	#if defined(PS_MEMCARD) || defined(PS_MOUSE)
+		#error "SNES_PAD takes PS port: PS_MEMCARD and PS_MOUSE must be off"
+	#endif
+#endif
+
+/************************************************************************************************************************/
+/*                                          binary trace on USART (see "trace.h")                                      */
+/************************************************************************************************************************/
+
+//#define TRACE /* records of events go from RAM ring to TXD (PD1) by UDRE interrupt, USB stays on */
+
+#ifdef DEBUG
+	#define STREAM /* every raw frame of PS or SEGA goes on TXD with trace records, polling goes at full rate */
+#endif
+
+#if defined(TRACE) || defined(STREAM)
+	#define TRACE_USART /* USART is taken by trace and stream */
+#endif
+
+#if defined(TRACE_USART) && (PS_ENGINE == PS_ENGINE_USART)
+	#error "PS_ENGINE_USART takes USART: TRACE and STREAM (DEBUG) can not be used with it"
+#endif
+
+#define TRACE_BAUD_MIN	1000000L	/* U2X mode: TRACE_BAUD is the slowest F_CPU / (8 * n) not below it (see "timing.h") */
+#define TRACE_RECORDS	16			/* ring size in records (power of 2), 4 bytes each */
+
+#include "timing.h"
+#include "report_fields.h"
@@ -1,5 +1,7 @@
 #include <avr/pgmspace.h>
 
+#define MOUSE_DESCR_LEN 50 /* "desc_mouse_report" below: its length goes in config descriptor before it */
+
 const int PROGMEM desc_prod_str[] = {
 	USB_STRING_DESCRIPTOR_HEADER(10),
 	's', 's', '_', 'g', 'a', 'm', 'e', 'p', 'a', 'd'
@@ -30,13 +32,13 @@ const uchar PROGMEM desc_conf[] = {
 	0x09,
 	USBDESCR_CONFIG,
 	TOTAL_LEN_DESCR, 0x00,  /* total length of data returned (including inlined descriptors) */
-	0x01,					/* number of interfaces in this configuration */
+	PLAYERS,				/* number of interfaces in this configuration: one gamepad per player */
 	0x01,					/* index of this configuration */
 	UNUSED,					/* configuration name string index */
 	USBATTR_BUSPOWER,
 	USB_CFG_MAX_BUS_POWER / 2,
 	
-	/************** Interface descriptor follows inline **************/
+	/********** 1st player: interface descriptor follows inline **********/
 	
 	// Standard interface descriptor:
 	0x09,
@@ -66,37 +68,98 @@ const uchar PROGMEM desc_conf[] = {
 	0x03,					/* bmAttributes: 0: Control, 1: Isochronous 2: Bulk, 3: Interrupt endpoint */
 	0x08, 0x00,				/* max packet size */
 	USB_CFG_INTR_POLL_INTERVAL,
+	
+	/*** 2nd player (or mouse, PS_MOUSE): interface descriptor follows inline ***/
+	
+	// Standard interface descriptor:
+	0x09,
+	USBDESCR_INTERFACE,
+	0x01,					/* index of this interface */
+	UNUSED,					/* alternate setting for this interface */
+	0x01,					/* amount endpoints that this interface is use, excl 0 */
+	USB_CFG_INTERFACE_CLASS,
+	USB_CFG_INTERFACE_SUBCLASS,
+	USB_CFG_INTERFACE_PROTOCOL,
+	UNUSED,					/* index of string descriptor for this interface */
+	
+	// Class-specific interface descriptor (the same report descriptor, or mouse one):
+	0x09,
+	USBDESCR_HID,
+	0x01, 0x01,				/* BCD representation of HID version */
+	0x00,					/* target country code (if needed) */
+	0x01,					/* number of HID Report (or other HID class) Descriptor infos to follow */
+	0x22,					/* descriptor type: report */
+#ifdef PS_MOUSE
+	MOUSE_DESCR_LEN, 0x00,
+#else
+	USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH, 0x00,
+#endif
+	
+	/***************** Bulk IN endpoint descriptors *****************/
+	
+	0x07,
+	USBDESCR_ENDPOINT,
+	0x80 | USB_CFG_EP3_NUMBER,	/* endpoint address: IN endpoint number 3 */
+	0x03,					/* bmAttributes: 0: Control, 1: Isochronous 2: Bulk, 3: Interrupt endpoint */
+	0x08, 0x00,				/* max packet size */
+	USB_CFG_INTR_POLL_INTERVAL,
 };
 
-// CAUTION: when changing report descriptor do not remember change "REPORT SIZE" define according with new form report packet
-//			and REPORT_DECRIPTOR_LENGT in "usbconfig.h"
+// fields of player report are generated from table in "report_fields.h", length - REPORT_DESCR_LEN
 const char PROGMEM usbDescriptorHidReport[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH] = {
 	0x05, 0x01,			// USAGE_PAGE (Generic Desktop)
 	0x09, 0x05,			// USAGE (Game Pad)
 	
 	0xA1, 0x01,			//	COLLECTION (Application)
 	
+	REPORT_FIELDS(HID_FIELD_ITEMS)
+	
+	0x06, 0x00, 0xFF,	//	USAGE_PAGE (Vendor Defined)
+	0x09, 0x01,			//	USAGE (Vendor Usage 1): config block, see "config.h"
+	0x15, 0x00,			//	LOGICAL_MINIMUM (0)
+	0x26, 0xFF, 0x00,	//	LOGICAL_MAXIMUM (255)
+	0x75, 0x08,			//	REPORT_SIZE (8)
+	0x95, CONFIG_SIZE,	//	REPORT_COUNT (CONFIG_SIZE)
+	0xB1, 0x02,			//	FEATURE (Data,Var,Abs)
+	
+	0xC0				//	END_COLLECTION
+};
+
+#ifdef PS_MOUSE
+
+// report: buttons (2 bits + padding), X, Y - 16 bit relative, see "mouseDrain"
+const char PROGMEM desc_mouse_report[] = {
+	0x05, 0x01,			// USAGE_PAGE (Generic Desktop)
+	0x09, 0x02,			// USAGE (Mouse)
+	
+	0xA1, 0x01,			//	COLLECTION (Application)
+	0x09, 0x01,			//		USAGE (Pointer)
+	0xA1, 0x00,			//		COLLECTION (Physical)
+	
 	0x05, 0x09,			//		USAGE_PAGE (Button)
 	0x19, 0x01,			//		USAGE_MINIMUM (Button 1)
-	0x29, 0x10,			//		USAGE_MAXIMUM (Button 16)
+	0x29, 0x02,			//		USAGE_MAXIMUM (Button 2)
 	0x15, 0x00,			//		LOGICAL_MINIMUM (0)
 	0x25, 0x01,			//		LOGICAL_MAXIMUM (1)
 	0x75, 0x01,			//		REPORT_SIZE (1)
-	0x95, 0x10,			//		REPORT_COUNT (16)
+	0x95, 0x02,			//		REPORT_COUNT (2)
 	0x81, 0x02,			//		INPUT (Data,Var,Abs)
+	0x95, 0x06,			//		REPORT_COUNT (6)
+	0x81, 0x03,			//		INPUT (Cnst,Var,Abs): padding
 	
-	0x09, 0x01,			//	USAGE_PAGE (Pointer)
-	0xA1, 0x00,			//	COLLECTION (Physical)
+	0x05, 0x01,			//		USAGE_PAGE (Generic Desktop)
 	0x09, 0x30,			//		USAGE (X)
 	0x09, 0x31,			//		USAGE (Y)
-	0x09, 0x33,			//		USAGE (Rx)
-	0x09, 0x34,			//		USAGE (Ry)
-	0x15, 0x00,			//		LOGICAL_MINIMUM (0)
-	0x26, 0xFF, 0x00,	//		LOGICAL_MAXIMUM (255)
-	0x75, 0x08,			//		REPORT_SIZE (8)
-	0x95, 0x04,			//		REPORT_COUNT (4)
-	0x81, 0x02,			//		INPUT (Data,Var,Abs)
-	0xC0,				//	END_COLLECTION
-
+	0x16, 0x01, 0x80,	//		LOGICAL_MINIMUM (-32767)
+	0x26, 0xFF, 0x7F,	//		LOGICAL_MAXIMUM (32767)
+	0x75, 0x10,			//		REPORT_SIZE (16)
+	0x95, 0x02,			//		REPORT_COUNT (2)
+	0x81, 0x06,			//		INPUT (Data,Var,Rel)
+	
+	0xC0,				//		END_COLLECTION
 	0xC0				//	END_COLLECTION
-};
\ No newline at end of file
+};
+
+typedef char mouse_descr_check[(sizeof(desc_mouse_report) == MOUSE_DESCR_LEN) ? 1 : -1]; // length is in config descriptor
+
+#endif
\ No newline at end of file
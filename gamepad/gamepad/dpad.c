@@ -0,0 +1,44 @@
+#include "dpad.h"
+
+uchar dpad_lut[16];
+uchar dpad_last = 0;
+uchar dpad_prev[PLAYERS][2];
+
+#ifdef DPAD_STICKY
+	uchar dpad_sticky[PLAYERS];
+#endif
+
+static uchar dpadHat(uchar n) // "n" without opposite directions
+{
+	static const uchar hat[16] = { // 0 - UP, then clockwise by 45 degrees, 8 - released (null)
+		8, 0, 4, 8,		// -, U, D, U+D
+		6, 7, 5, 8,		// L, U+L, D+L, -
+		2, 1, 3, 8,		// R, U+R, D+R, -
+		8, 8, 8, 8		// L+R: not used
+	};
+	
+	return hat[n];
+}
+
+void dpadCompile(uchar mode)
+{
+	uchar n, res, cancel;
+	
+	if(mode >= DPAD_MODES) mode = DPAD_MODE_NONE;
+	dpad_last = (mode == DPAD_MODE_LAST) ? 0x0F : 0x00;
+	
+	for(n = 0; n < 16; n++)
+	{
+		cancel = n;
+		if((n & (DPAD_UP | DPAD_DOWN)) == (DPAD_UP | DPAD_DOWN)) cancel &= ~(DPAD_UP | DPAD_DOWN);
+		if((n & (DPAD_LEFT | DPAD_RIGHT)) == (DPAD_LEFT | DPAD_RIGHT)) cancel &= ~(DPAD_LEFT | DPAD_RIGHT);
+		
+		if(mode == DPAD_MODE_NONE) res = n;
+		else if((mode == DPAD_MODE_UP) & ((n & (DPAD_UP | DPAD_DOWN)) == (DPAD_UP | DPAD_DOWN))) res = cancel | DPAD_UP;
+		else res = cancel; // in DPAD_MODE_LAST only opposite pressed at once are left here
+		
+		dpad_lut[n] = res | (dpadHat((mode == DPAD_MODE_NONE) ? cancel : res) << 4);
+	}
+	
+	for(n = 0; n < PLAYERS; n++) dpadReset(n);
+}
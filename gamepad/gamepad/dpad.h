@@ -0,0 +1,82 @@
+#ifndef DPAD_H_
+#define DPAD_H_
+
+#include "defines.h"
+
+#include <stdint.h>
+
+#ifndef uchar
+	#define uchar unsigned char
+#endif
+
+/*********************************************************************************/
+/* SOCD cleaning and hat switch: direction nibble of player goes through one     */
+/* 16 entry table of mode ("cfg.dpad_mode"), compiled at load time like remap:   */
+/*		dpad_lut[n] - cleaned nibble (low), hat value (high) for nibble "n"      */
+/* last input wins needs previous state: opposite direction pressed right now    */
+/* takes the place of held one by masks, so every mode costs the same ops and    */
+/* one lookup, no branches on report path                                        */
+/* nibble: bit 0 - UP, 1 - DOWN, 2 - LEFT, 3 - RIGHT (as SEGA report byte)       */
+/* STICKY_PRESS: directions pressed since last sent report are added to input    */
+/* before lookup, so taps go through cleaning and hat too (see "history.h")      */
+/*********************************************************************************/
+
+#define DPAD_MODE_NONE		0 /* opposite directions go as they are, hat - as they cancel */
+#define DPAD_MODE_NEUTRAL	1 /* opposite directions cancel */
+#define DPAD_MODE_LAST		2 /* last pressed of opposite wins, pressed at once - neutral */
+#define DPAD_MODE_UP		3 /* UP wins over DOWN, LEFT + RIGHT - neutral (hitbox) */
+#define DPAD_MODES			4
+
+#define DPAD_UP		0x01
+#define DPAD_DOWN	0x02
+#define DPAD_LEFT	0x04
+#define DPAD_RIGHT	0x08
+
+extern uchar dpad_lut[16];
+extern uchar dpad_last; // 0x0F in DPAD_MODE_LAST, else 0: turns off previous state
+extern uchar dpad_prev[PLAYERS][2]; // input and output nibble of previous sample
+
+#if defined(STICKY_PRESS) && !defined(FW_HOST) // host tools send every sample
+	#define DPAD_STICKY
+#endif
+
+#ifdef DPAD_STICKY
+	extern uchar dpad_sticky[PLAYERS]; // input since last sent report, cleared by "historySend"
+#endif
+
+void dpadCompile(uchar mode); // unknown mode - DPAD_MODE_NONE
+
+static inline void dpadReset(uchar player) // other controller takes player: state of previous one is not carried over
+{
+	dpad_prev[player][0] = 0;
+	dpad_prev[player][1] = 0;
+	
+	#ifdef DPAD_STICKY
+		dpad_sticky[player] = 0;
+	#endif
+}
+
+static inline uchar dpadClean(uchar player, uchar dirs) // return cleaned nibble | hat << 4
+{
+	uchar both, pressed, keep, in, res;
+	
+#ifdef DPAD_STICKY
+	dirs |= dpad_sticky[player]; // LEFT, then RIGHT before report is sent: LEFT + RIGHT is cleaned by mode
+	dpad_sticky[player] = dirs;
+#endif
+	
+	both = dirs & (dirs >> 1) & 0x05; // pairs with both directions pressed
+	both |= both << 1;
+	
+	pressed = dirs & ~dpad_prev[player][0] & both; // opposite one has come right now
+	keep = dpad_prev[player][1] & both & ~(pressed | ((pressed & 0x05) << 1) | ((pressed & 0x0A) >> 1)); // held winner
+	
+	in = (dirs & ~(both & dpad_last)) | ((pressed | keep) & dpad_last);
+	res = dpad_lut[in];
+	
+	dpad_prev[player][0] = dirs;
+	dpad_prev[player][1] = res & 0x0F;
+	return res;
+}
+
+#endif /* DPAD_H_ */
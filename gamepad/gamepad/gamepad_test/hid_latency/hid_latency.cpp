@@ -0,0 +1,441 @@
+/*********************************************************************************/
+/* report latency and jitter analyzer for Linux hidraw                           */
+/*                                                                               */
+/* build (options must be the same as for firmware, see "fw_host.h"):           */
+/*		g++ -O2 -std=c++17 -I../host [-DREPORT_STAMP] -o hid_latency hid_latency.cpp */
+/* run:                                                                          */
+/*		hid_latency [-n reports] [-t sec] [-b bin_us] [-p ms] [-f] [/dev/hidrawN ...] */
+/*	without nodes all hidraw nodes with VID/PID of firmware are opened (one node */
+/*	per player), virtual adapter on /dev/uhid ("uhid_adapter") is found the same */
+/*	way, so tool works in CI without hardware                                    */
+/*                                                                               */
+/* per node: histogram of intervals between reports (CLOCK_MONOTONIC at read),   */
+/* ratio of duplicate reports (buttons and axes same as in previous report),     */
+/* with REPORT_STAMP - lost and repeated sequence numbers and jitter of latency   */
+/* "latch in MC -> read on host" (MC timer 1 stamp vs host time, relative to     */
+/* min, so unknown constant offset of clocks goes away)                          */
+/*                                                                               */
+/* -p: host-synced sampling, VENDOR_RQ_POLL_NOW every "ms" (like render loop of  */
+/* emulator), round trip "request sent -> next report read" per node and time    */
+/* of control transfer itself; needs access to /dev/bus/usb of adapter too       */
+/*********************************************************************************/
+
+#include "fw_host.h"
+#include "fw_usb.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/hidraw.h>
+
+#define HIST_BINS	32			/* + 1 bin for everything longer */
+#define MAX_NODES	PLAYERS
+#define SCAN_NODES	64			/* /dev/hidraw0..63 */
+
+#define TICK_US		(TICK_T1_PRESC * 1000000.0 / F_CPU)	/* MC timer 1 tick */
+#define DATA_BYTES	REPORT_DATA_SIZE						/* buttons and axes: part of report for duplicate check */
+
+volatile uint16_t TCNT1; // required by firmware headers, not used here
+
+struct hist_t
+{
+	uint64_t bin[HIST_BINS + 1];
+	uint64_t cnt;
+	double sum, sum_sq, min, max;
+};
+
+struct node_t
+{
+	std::string path;
+	int fd;
+
+	uint64_t reports;
+	uint64_t dups;
+	uint64_t bad_len;
+
+	uchar last[REPORT_SIZE];
+	double last_us; // < 0 - no report yet
+	hist_t interval;
+
+// REPORT_STAMP:
+	uint64_t seq_lost;
+	uint64_t seq_rep;
+	uint64_t seq_reset;
+	double dev_us; // unwrapped MC time
+	uint16_t dev_tick;
+	std::vector<double> lat; // host - MC time, us
+
+// VENDOR_RQ_POLL_NOW (-p):
+	bool wait_poll; // request is sent, its report is not read yet
+	hist_t rtt;
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void onSignal(int)
+{
+	stop = 1;
+}
+
+static double nowUs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void histAdd(hist_t *h, double val, double bin_us)
+{
+	int i = (int)(val / bin_us);
+
+	if(i > HIST_BINS) i = HIST_BINS;
+	if(i < 0) i = 0;
+
+	h -> bin[i]++;
+
+	if((h -> cnt == 0) || (val < h -> min)) h -> min = val;
+	if((h -> cnt == 0) || (val > h -> max)) h -> max = val;
+
+	h -> cnt++;
+	h -> sum += val;
+	h -> sum_sq += val * val;
+}
+
+static void histPrint(const char *name, const hist_t *h, double bin_us)
+{
+	if(h -> cnt == 0)
+	{
+		printf("  %s: no data\n", name);
+		return;
+	}
+
+	double mean = h -> sum / h -> cnt;
+	double var = h -> sum_sq / h -> cnt - mean * mean;
+	uint64_t peak = 0;
+
+	printf("  %s, us: min %.1f, mean %.1f, max %.1f, stddev %.1f\n", name, h -> min, mean, h -> max,
+		   sqrt(var > 0 ? var : 0));
+
+	for(int i = 0; i <= HIST_BINS; i++)
+		if(h -> bin[i] > peak) peak = h -> bin[i];
+
+	for(int i = 0; i <= HIST_BINS; i++)
+	{
+		if(h -> bin[i] == 0) continue;
+
+		int bar = (int)(h -> bin[i] * 50 / peak);
+
+		if(i < HIST_BINS) printf("    %7.0f..%-7.0f", i * bin_us, (i + 1) * bin_us);
+		else printf("    %7.0f..       ", i * bin_us);
+
+		printf(" %10" PRIu64 " %s\n", h -> bin[i], std::string(bar, '#').c_str());
+	}
+}
+
+static int openNode(const char *path, bool force, node_t *node)
+{
+	int fd = open(path, O_RDONLY | O_NONBLOCK);
+
+	if(fd < 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+// report descriptor of device must be the one this tool was built with:
+	struct hidraw_report_descriptor rdesc;
+	int size = 0;
+
+	memset(&rdesc, 0, sizeof(rdesc));
+
+	if((ioctl(fd, HIDIOCGRDESCSIZE, &size) < 0) || (size > HID_MAX_DESCRIPTOR_SIZE))
+	{
+		fprintf(stderr, "%s: can not get report descriptor\n", path);
+		close(fd);
+		return -1;
+	}
+
+	rdesc.size = size;
+	ioctl(fd, HIDIOCGRDESC, &rdesc);
+
+	if(((size_t)size != sizeof(usbDescriptorHidReport)) || memcmp(rdesc.value, usbDescriptorHidReport, size))
+	{
+		fprintf(stderr, "%s: report descriptor differs from \"descriptor.h\" (%d vs %zu bytes), "
+				"firmware is built with other options%s\n", path, size, sizeof(usbDescriptorHidReport),
+				force ? "" : " (-f to ignore)");
+
+		if(!force)
+		{
+			close(fd);
+			return -1;
+		}
+	}
+
+	node -> path = path;
+	node -> fd = fd;
+	node -> last_us = -1;
+	return 0;
+}
+
+static int scanNodes(bool force, std::vector<node_t> &nodes)
+{
+	char path[32];
+
+	for(int i = 0; (i < SCAN_NODES) && (nodes.size() < MAX_NODES); i++)
+	{
+		snprintf(path, sizeof(path), "/dev/hidraw%d", i);
+
+		int fd = open(path, O_RDONLY | O_NONBLOCK);
+		if(fd < 0) continue;
+
+		struct hidraw_devinfo info;
+		int res = ioctl(fd, HIDIOCGRAWINFO, &info);
+		close(fd);
+
+		if((res < 0) || ((uint16_t)info.vendor != FW_VENDOR_ID) || ((uint16_t)info.product != FW_DEVICE_ID)) continue;
+
+		node_t node = node_t();
+		if(openNode(path, force, &node) == 0) nodes.push_back(node);
+	}
+
+	return nodes.size();
+}
+
+static void onReport(node_t *node, const uchar *report, int len, double t_us, double bin_us, double poll_us)
+{
+	if(len != REPORT_SIZE)
+	{
+		node -> bad_len++;
+		return;
+	}
+
+	if(node -> wait_poll)
+	{
+		histAdd(&node -> rtt, t_us - poll_us, bin_us);
+		node -> wait_poll = false;
+	}
+
+	if(node -> last_us >= 0)
+	{
+		histAdd(&node -> interval, t_us - node -> last_us, bin_us);
+		if(memcmp(node -> last, report, DATA_BYTES) == 0) node -> dups++;
+	}
+
+#ifdef REPORT_STAMP
+	uchar seq = report[REPORT_OFS(SEQ)];
+	uint16_t tick = report[REPORT_OFS(TIME)] | (report[REPORT_OFS(TIME) + 1] << 8);
+
+	if(node -> reports == 0) node -> dev_us = 0;
+	else
+	{
+		uchar diff = seq - node -> last[REPORT_OFS(SEQ)];
+
+		if(diff == 0) node -> seq_rep++; // the same sample sent again
+		else if(diff < 128) node -> seq_lost += diff - 1;
+		else node -> seq_reset++; // MC reset or reordering
+
+		node -> dev_us += (uint16_t)(tick - node -> dev_tick) * TICK_US; // one wrap ~ 262 ms at 16 MHz, reports go faster
+	}
+
+	node -> dev_tick = tick;
+	node -> lat.push_back(t_us - node -> dev_us);
+#endif
+
+	memcpy(node -> last, report, REPORT_SIZE);
+	node -> last_us = t_us;
+	node -> reports++;
+}
+
+static void printNode(const node_t *node, double bin_us)
+{
+	printf("%s: %" PRIu64 " reports", node -> path.c_str(), node -> reports);
+	if(node -> bad_len) printf(", %" PRIu64 " with wrong length", node -> bad_len);
+	printf("\n");
+
+	if(node -> reports > 1)
+		printf("  duplicates: %" PRIu64 " (%.1f %%)\n", node -> dups, 100.0 * node -> dups / (node -> reports - 1));
+
+	histPrint("interval", &node -> interval, bin_us);
+	if(node -> rtt.cnt) histPrint("poll now -> read (round trip)", &node -> rtt, bin_us);
+
+#ifdef REPORT_STAMP
+	printf("  sequence: %" PRIu64 " lost, %" PRIu64 " repeated, %" PRIu64 " resets\n",
+		   node -> seq_lost, node -> seq_rep, node -> seq_reset);
+
+	if(node -> lat.empty()) return;
+
+// latency up to constant offset: min is taken as 0
+	double min = node -> lat[0];
+	hist_t lat = hist_t();
+
+	for(double v : node -> lat)
+		if(v < min) min = v;
+
+	for(double v : node -> lat) histAdd(&lat, v - min, bin_us);
+
+	histPrint("latch -> read jitter (MC and host clocks drift, keep runs short)", &lat, bin_us);
+#endif
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: hid_latency [-n reports] [-t sec] [-b bin_us] [-p ms] [-f] [/dev/hidrawN ...]\n"
+					"  -n  stop after N reports on each node\n"
+					"  -t  stop after T seconds\n"
+					"  -b  histogram bin, us (default 1000)\n"
+					"  -p  send \"poll now\" request every ms, measure round trip\n"
+					"  -f  open nodes with other report descriptor\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t max_reports = 0;
+	double max_sec = 0;
+	double bin_us = 1000;
+	double poll_ms = 0;
+	bool force = false;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:t:b:p:fh")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n': max_reports = strtoull(optarg, NULL, 0); break;
+			case 't': max_sec = atof(optarg); break;
+			case 'b': bin_us = atof(optarg); break;
+			case 'p': poll_ms = atof(optarg); break;
+			case 'f': force = true; break;
+			default: usage(); return 2;
+		}
+	}
+
+	if((bin_us <= 0) || (poll_ms < 0))
+	{
+		usage();
+		return 2;
+	}
+
+	std::vector<node_t> nodes;
+
+	if(optind < argc)
+	{
+		for(int i = optind; i < argc; i++)
+		{
+			node_t node = node_t();
+			if(openNode(argv[i], force, &node) == 0) nodes.push_back(node);
+		}
+	}
+	else if(scanNodes(force, nodes) == 0)
+		fprintf(stderr, "no hidraw node with ID %04x:%04x\n", FW_VENDOR_ID, FW_DEVICE_ID);
+
+	if(nodes.empty()) return 1;
+
+	int usb_fd = -1;
+
+	if((poll_ms > 0) && ((usb_fd = fwOpenAdapter()) < 0)) return 1;
+
+	int ep = epoll_create1(0);
+
+	for(size_t i = 0; i < nodes.size(); i++)
+	{
+		struct epoll_event ev;
+
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		epoll_ctl(ep, EPOLL_CTL_ADD, nodes[i].fd, &ev);
+
+		printf("reading %s\n", nodes[i].path.c_str());
+	}
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	double start = nowUs();
+	double poll_us = 0, next_poll = start; // time of last "poll now" request
+	hist_t ctrl = hist_t(); // control transfer of request
+	struct epoll_event evs[MAX_NODES];
+	uchar buf[64];
+
+	while(!stop)
+	{
+		if((usb_fd >= 0) && (nowUs() >= next_poll))
+		{
+			poll_us = nowUs();
+
+			for(node_t &node : nodes) node.wait_poll = true; // report that was on the way is taken as answer too
+
+			if(fwControl(usb_fd, FW_RQ_OUT, VENDOR_RQ_POLL_NOW, 0, NULL, 0) < 0)
+			{
+				fprintf(stderr, "poll now: %s\n", strerror(errno));
+				break;
+			}
+
+			histAdd(&ctrl, nowUs() - poll_us, bin_us);
+			next_poll += poll_ms * 1000;
+			if(next_poll < nowUs()) next_poll = nowUs(); // host was late: no burst of requests
+		}
+
+		int timeout = (usb_fd >= 0) ? 1 : 100;
+		int n = epoll_wait(ep, evs, MAX_NODES, timeout);
+
+		if((n < 0) && (errno != EINTR)) break;
+
+		for(int i = 0; i < n; i++)
+		{
+			node_t *node = &nodes[evs[i].data.u32];
+			int len;
+
+			while((len = read(node -> fd, buf, sizeof(buf))) > 0) // stamp every report, not only the 1st after wake
+				onReport(node, buf, len, nowUs(), bin_us, poll_us);
+
+			if((len < 0) && (errno != EAGAIN))
+			{
+				fprintf(stderr, "%s: %s\n", node -> path.c_str(), strerror(errno)); // unplugged
+				stop = 1;
+			}
+		}
+
+		if((max_sec > 0) && (nowUs() - start >= max_sec * 1e6)) break;
+
+		if(max_reports)
+		{
+			bool done = true;
+
+			for(const node_t &node : nodes)
+				if(node.reports < max_reports) done = false;
+
+			if(done) break;
+		}
+	}
+
+	printf("\n%.1f s, tick of MC timer 1: %.2f us\n", (nowUs() - start) / 1e6, TICK_US);
+
+	if(usb_fd >= 0)
+	{
+		histPrint("poll now request (control transfer)", &ctrl, bin_us);
+		close(usb_fd);
+	}
+
+	for(const node_t &node : nodes)
+	{
+		printNode(&node, bin_us);
+		close(node.fd);
+	}
+
+	close(ep);
+	return 0;
+}
@@ -0,0 +1,71 @@
+/*********************************************************************************/
+/* dump of input history ring (HISTORY, see "history.h") for "missed input"      */
+/* complaints: button changes in controller samples and every sent report       */
+/*                                                                               */
+/* build (options must be the same as for firmware, see "fw_host.h"):           */
+/*		g++ -O2 -std=c++17 -I../host -o history_dump history_dump.cpp            */
+/* run (needs access to /dev/bus/usb of adapter):                                */
+/*		history_dump                                                             */
+/*                                                                               */
+/* one line per record from oldest: time in us relative to newest record (timer  */
+/* 1 of MC wraps in ~ 262 ms at 16 MHz, so older gaps are not exact), player,    */
+/* "sample" or "sent", buttons; sent buttons that were not in the sample just    */
+/* before it came from sticky press (STICKY_PRESS)                               */
+/*********************************************************************************/
+
+#include "fw_host.h"
+#include "fw_usb.h"
+
+#define TICK_US		(TICK_T1_PRESC * 1000000.0 / F_CPU)	/* MC timer 1 tick */
+
+volatile uint16_t TCNT1; // required by firmware headers, not used here
+
+int main()
+{
+	uchar buf[sizeof(hist_head_t) + 255];
+	int fd = fwOpenAdapter();
+
+	if(fd < 0) return 1;
+
+	int len = fwControl(fd, FW_RQ_IN, VENDOR_RQ_HISTORY, 0, buf, sizeof(buf));
+
+	close(fd);
+
+	if(len < (int)sizeof(hist_head_t))
+	{
+		fprintf(stderr, "history: %s\n", (len < 0) ? strerror(errno) : "short transfer (HISTORY is off?)");
+		return 1;
+	}
+
+	hist_head_t head;
+	int count;
+
+	memcpy(&head, buf, sizeof(head));
+	count = (len - (int)sizeof(head)) / (int)sizeof(hist_rec_t);
+
+	if(count > head.count) count = head.count;
+
+	hist_rec_t *rec = (hist_rec_t *)(buf + sizeof(head));
+	uint16_t newest = count ? rec[count - 1].time : 0;
+	uint16_t last_btn[PLAYERS] = {0};
+
+	for(int i = 0; i < count; i++)
+	{
+		int player = rec[i].info & HIST_PLAYER_MASK;
+		uint16_t btn = rec[i].btn[0] | (rec[i].btn[1] << 8);
+		bool sent = rec[i].info & HIST_SENT;
+
+		printf("%10.1f  %d  %-6s %04X", -(uint16_t)(newest - rec[i].time) * TICK_US, player, sent ? "sent" : "sample", btn);
+
+		if(player < PLAYERS)
+		{
+			if(sent && (btn & ~last_btn[player])) printf("  sticky %04X", btn & ~last_btn[player]);
+			if(!sent) last_btn[player] = btn;
+		}
+
+		printf("\n");
+	}
+
+	fprintf(stderr, "%d records, %u events lost while previous read\n", count, head.lost);
+	return 0;
+}
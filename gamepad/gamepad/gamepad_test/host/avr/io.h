@@ -0,0 +1,21 @@
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+/*********************************************************************************/
+/* host build of firmware headers (see "fw_host.h"): registers that shared code  */
+/* touches are plain variables, the rest of <avr/io.h> is not required           */
+/*********************************************************************************/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern volatile uint16_t TCNT1; // time base for report stamps, defined by host program
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_AVR_IO_H_ */
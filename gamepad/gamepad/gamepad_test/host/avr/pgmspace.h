@@ -0,0 +1,9 @@
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+// host has no separate flash space: descriptors are ordinary const arrays
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+
+#endif /* HOST_AVR_PGMSPACE_H_ */
@@ -0,0 +1,42 @@
+#ifndef FW_HOST_H_
+#define FW_HOST_H_
+
+/*********************************************************************************/
+/* firmware headers for Linux tools: layout of report, USB descriptors and IDs   */
+/* come from the same sources as in MC, so tool can not drift from firmware      */
+/* build options (REPORT_STAMP, ...) must be the same as for firmware:           */
+/*		g++ -I../host [-DREPORT_STAMP] ...                                       */
+/* firmware .c files (report.c, remap.c, dpad.c) are built by C compiler and     */
+/* linked                                                                        */
+/*********************************************************************************/
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wnarrowing" // "usbDescriptorHidReport" is "char" array of bytes > 0x7F in V-USB
+
+#define FW_HOST // headers leave out code that touches MC registers
+
+extern "C" {
+	#include "../../defines.h"
+	#include "../../usbdrv/usbdrv.h"
+	#include "../../config.h"
+	#include "../../report.h"
+	#include "../../dpad.h"
+	#include "../../stamp.h"
+	#include "../../trace.h"
+	#include "../../vendor.h"
+	#include "../../memcard.h"
+	#include "../../history.h"
+	#include "../../descriptor.h" /* last, as in firmware */
+}
+
+#pragma GCC diagnostic pop
+
+// USB IDs as numbers (usbconfig.h keeps them as "low, high" byte pairs):
+	#define FW_WORD(lo, hi) ((uint16_t)((lo) | ((hi) << 8)))
+	#define FW_WORD_(args) FW_WORD args
+
+	#define FW_VENDOR_ID	FW_WORD_((USB_CFG_VENDOR_ID))
+	#define FW_DEVICE_ID	FW_WORD_((USB_CFG_DEVICE_ID))
+	#define FW_VERSION		FW_WORD_((USB_CFG_DEVICE_VERSION))
+
+#endif /* FW_HOST_H_ */
@@ -0,0 +1,88 @@
+#ifndef FW_USB_H_
+#define FW_USB_H_
+
+/*********************************************************************************/
+/* vendor requests to adapter from Linux tools (see "vendor.h"): usbdevfs, no    */
+/* libusb is required; device is found by VID/PID of firmware in /sys            */
+/* include after "fw_host.h"                                                     */
+/*********************************************************************************/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/usbdevice_fs.h>
+
+#define FW_RQ_IN		0xC0 /* vendor, device, IN */
+#define FW_RQ_OUT		0x40
+#define FW_TIMEOUT_MS	5000
+
+static long fwReadNum(const std::string &path, int base)
+{
+	FILE *f = fopen(path.c_str(), "r");
+	char buf[32];
+	long val = -1;
+
+	if(!f) return -1;
+	if(fgets(buf, sizeof(buf), f)) val = strtol(buf, NULL, base);
+
+	fclose(f);
+	return val;
+}
+
+static int fwOpenAdapter() // first device with VID/PID of firmware, -1 - not found (message is printed)
+{
+	DIR *dir = opendir("/sys/bus/usb/devices");
+	struct dirent *ent;
+	int fd = -1;
+
+	if(!dir)
+	{
+		fprintf(stderr, "/sys/bus/usb/devices: %s\n", strerror(errno));
+		return -1;
+	}
+
+	while((fd < 0) && (ent = readdir(dir)))
+	{
+		std::string dev = std::string("/sys/bus/usb/devices/") + ent -> d_name + "/";
+
+		if((fwReadNum(dev + "idVendor", 16) != FW_VENDOR_ID) || (fwReadNum(dev + "idProduct", 16) != FW_DEVICE_ID)) continue;
+
+		char node[64];
+
+		snprintf(node, sizeof(node), "/dev/bus/usb/%03ld/%03ld", fwReadNum(dev + "busnum", 10), fwReadNum(dev + "devnum", 10));
+		fd = open(node, O_RDWR);
+
+		if(fd < 0) fprintf(stderr, "%s: %s\n", node, strerror(errno));
+	}
+
+	closedir(dir);
+
+	if(fd < 0) fprintf(stderr, "adapter %04x:%04x is not found\n", FW_VENDOR_ID, FW_DEVICE_ID);
+	return fd;
+}
+
+static int fwControl(int fd, uchar type, uchar rq, uint16_t value, void *data, uint16_t len) // bytes or -1 (errno)
+{
+	struct usbdevfs_ctrltransfer ctrl;
+
+	memset(&ctrl, 0, sizeof(ctrl));
+	ctrl.bRequestType = type;
+	ctrl.bRequest = rq;
+	ctrl.wValue = value;
+	ctrl.wIndex = 0;
+	ctrl.wLength = len;
+	ctrl.timeout = FW_TIMEOUT_MS;
+	ctrl.data = data;
+
+	return ioctl(fd, USBDEVFS_CONTROL, &ctrl);
+}
+
+#endif /* FW_USB_H_ */
@@ -0,0 +1,454 @@
+/*********************************************************************************/
+/* static worst-case check of USB interrupt blocking for linked firmware         */
+/*                                                                               */
+/* V-USB: USB interrupt must not be disabled for more than 25 cycles (see        */
+/* "usbdrv.h"), so every other ISR must reach "sei" in time; tool disassembles   */
+/* ELF (avr-objdump -d), walks control flow of every ISR ("__vector_N") and of   */
+/* every "cli" section in code, and counts worst-case cycles:                    */
+/*		to sei	- from interrupt request to "sei" taking effect (4 cycles of      */
+/*				  response + jmp in vector table + path + 1 instruction after sei) */
+/*		total	- from request to "reti", with called functions: information     */
+/*				  only, "?" when code after "sei" has loops                      */
+/*		blocked	- from "cli" to "sei" or SREG restore; "cli" inside ISR - to     */
+/*				  "sei" or "reti" (SREG of ISR epilogue has I = 0)               */
+/* exit code 1 when blocking of any ISR or cli section is over budget or can not */
+/* be bounded, so it is run after every firmware build:                          */
+/*                                                                               */
+/* build:                                                                        */
+/*		g++ -O2 -std=c++17 -o isr_latency isr_latency.cpp                        */
+/*	or "make check" (Makefile here): builds tool and runs it on Release ELF of   */
+/*	Atmel Studio project with "-f segaDecode:SEGA_DECODE_CYCLES"                 */
+/* run:                                                                          */
+/*		isr_latency [-b cycles] [-u vector] [-f func:cycles] [-d avr-objdump] [-i file.lss] firmware.elf */
+/*	-b - budget (default 25), -u - USB vector that is not checked (default 1:    */
+/*	INT0, 2 for INT1 in REPORT_STAMP build), -i - read ready disassembly         */
+/*	(Atmel Studio .lss) instead of ELF                                           */
+/*	-f - worst case of hot function from entry to "ret" against own budget, can  */
+/*	be repeated: "-f segaDecode:56" (SEGA_DECODE_CYCLES, "report.h")             */
+/*                                                                               */
+/* cycles are for AVRe core (ATmega88), loops and indirect calls with interrupts */
+/* disabled can not be bounded statically and fail the check                     */
+/*********************************************************************************/
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#define CYC_RESPONSE	4		/* interrupt response of AVRe */
+#define CYC_VECTOR		3		/* "jmp" in vector table */
+#define CYC_CALL		4		/* "call" of hot function by caller */
+#define CYC_UNBOUND		-1
+
+struct instr_t
+{
+	unsigned addr;
+	int words;
+	std::string op;
+	std::string args;
+	long target; // branch or call target, -1 - none
+};
+
+static std::map<unsigned, instr_t> code;
+static std::map<std::string, unsigned> symbols;
+static std::string error; // why path can not be bounded
+
+/*********************************************************************************/
+/*                             objdump parser                                    */
+/*********************************************************************************/
+
+static bool parseLine(const char *line)
+{
+	unsigned addr;
+	char sym[128];
+
+	if(sscanf(line, "%x <%127[^>]>:", &addr, sym) == 2)
+	{
+		symbols[sym] = addr;
+		return true;
+	}
+
+// "  68:	1f 92       	push	r1" - address, hex bytes, mnemonic, args
+	const char *p = line;
+	char *end;
+
+	while(*p == ' ') p++;
+
+	addr = strtoul(p, &end, 16);
+	if((end == p) || (*end != ':')) return false;
+	p = end + 1;
+
+	int bytes = 0;
+
+	while(*p == ' ' || *p == '\t') p++;
+
+	while(isxdigit(p[0]) && isxdigit(p[1]) && (p[2] == ' ' || p[2] == '\t'))
+	{
+		bytes++;
+		p += 3;
+		while(*p == ' ') p++;
+	}
+
+	while(*p == ' ' || *p == '\t') p++;
+	if((bytes == 0) || !isalpha(*p)) return false; // data or empty line
+
+	instr_t in;
+	char op[16];
+	int n = 0;
+
+	sscanf(p, "%15s%n", op, &n);
+
+	in.addr = addr;
+	in.words = bytes / 2;
+	in.op = op;
+	in.target = -1;
+
+	p += n;
+	while(*p == ' ' || *p == '\t') p++;
+	in.args = p;
+
+	size_t nl = in.args.find_first_of("\r\n");
+	if(nl != std::string::npos) in.args.erase(nl);
+
+// target: "; 0x1a4 <...>" comment for relative jumps, plain "0x1a4" for jmp/call:
+	size_t c = in.args.find("; 0x");
+	if(c != std::string::npos) in.target = strtoul(in.args.c_str() + c + 2, NULL, 16);
+	else if((in.op == "jmp") || (in.op == "call")) in.target = strtoul(in.args.c_str(), NULL, 16);
+
+	code[addr] = in;
+	return true;
+}
+
+static bool loadDisasm(FILE *f)
+{
+	char line[512];
+
+	while(fgets(line, sizeof(line), f)) parseLine(line);
+	return !code.empty();
+}
+
+/*********************************************************************************/
+/*                               cycle table                                     */
+/*********************************************************************************/
+
+static bool isBranch(const std::string &op) // conditional relative branch: 1 / 2 taken
+{
+	return (op.size() == 4) && (op[0] == 'b') && (op != "bset") && (op != "bclr") && (op != "break");
+}
+
+static bool isSkip(const std::string &op) // 1 / 2 or 3 on skip of 1 or 2 word instruction
+{
+	return (op == "cpse") || (op == "sbrc") || (op == "sbrs") || (op == "sbic") || (op == "sbis");
+}
+
+static int cycles(const instr_t &in)
+{
+	static const std::set<std::string> two = {
+		"adiw", "sbiw", "mul", "muls", "mulsu", "fmul", "fmuls", "fmulsu", "ld", "ldd", "lds", "st", "std", "sts",
+		"push", "pop", "sbi", "cbi", "rjmp", "ijmp"
+	};
+	static const std::set<std::string> three = {"jmp", "rcall", "icall", "lpm"};
+	static const std::set<std::string> four = {"call", "ret", "reti"};
+
+	if(two.count(in.op)) return 2;
+	if(three.count(in.op)) return 3;
+	if(four.count(in.op)) return 4;
+	return 1; // ALU, mov, in/out, bit ops, sei/cli, nop, branch and skip not taken
+}
+
+static bool isSregRestore(const instr_t &in) // "out 0x3f, rN" - restores I flag saved before "cli"
+{
+	return (in.op == "out") && (in.args.compare(0, 4, "0x3f") == 0 || in.args.compare(0, 2, "63") == 0);
+}
+
+/*********************************************************************************/
+/*           worst path: DFS over CFG, code of ISR and functions is DAG          */
+/*********************************************************************************/
+
+#define MODE_TOTAL	0 /* to ret/reti, with callees */
+#define MODE_SEI	1 /* ISR and cli inside ISR: to sei, reti if there is no sei on path (SREG in epilogue has I = 0) */
+#define MODE_CLI	2 /* cli section: to sei or restore of SREG */
+
+static std::map<unsigned, long> memo[3];
+static std::set<unsigned> on_path[3];
+
+static long funcCycles(unsigned addr);
+
+static long worst(unsigned addr, int mode)
+{
+	auto it = code.find(addr);
+
+	if(it == code.end())
+	{
+		char buf[64];
+		snprintf(buf, sizeof(buf), "no code at 0x%x", addr);
+		error = buf;
+		return CYC_UNBOUND;
+	}
+
+	auto m = memo[mode].find(addr);
+	if(m != memo[mode].end()) return m -> second;
+
+	if(on_path[mode].count(addr))
+	{
+		char buf[64];
+		snprintf(buf, sizeof(buf), "loop at 0x%x", addr);
+		error = buf;
+		return CYC_UNBOUND;
+	}
+
+	const instr_t &in = it -> second;
+	unsigned next = addr + in.words * 2;
+	long res = CYC_UNBOUND;
+	long a, b;
+
+	on_path[mode].insert(addr);
+
+	if((in.op == "ret") || (in.op == "reti")) res = cycles(in);
+	else if(((mode == MODE_SEI) && (in.op == "sei")) || ((mode == MODE_CLI) && (in.op == "sei" || isSregRestore(in))))
+	{ // I is set after next instruction:
+		auto n = code.find(next);
+		res = 1 + ((n != code.end()) ? cycles(n -> second) : 0);
+	}
+	else if((in.op == "ijmp") || (in.op == "icall") || (in.op == "eijmp") || (in.op == "eicall"))
+		error = "indirect " + in.op + " at 0x" + std::to_string(addr);
+	else if((in.op == "jmp") || (in.op == "rjmp"))
+	{
+		if((a = worst(in.target, mode)) >= 0) res = cycles(in) + a;
+	}
+	else if((in.op == "call") || (in.op == "rcall"))
+	{
+		if(((a = funcCycles(in.target)) >= 0) && ((b = worst(next, mode)) >= 0)) res = cycles(in) + a + b;
+	}
+	else if(isBranch(in.op))
+	{
+		if(((a = worst(next, mode)) >= 0) && ((b = worst(in.target, mode)) >= 0))
+			res = (1 + a > 2 + b) ? 1 + a : 2 + b;
+	}
+	else if(isSkip(in.op))
+	{
+		auto n = code.find(next);
+
+		if(n != code.end())
+		{
+			unsigned after = next + n -> second.words * 2;
+
+			if(((a = worst(next, mode)) >= 0) && ((b = worst(after, mode)) >= 0))
+				res = (1 + a > 1 + n -> second.words + b) ? 1 + a : 1 + n -> second.words + b;
+		}
+	}
+	else if((a = worst(next, mode)) >= 0) res = cycles(in) + a;
+
+	on_path[mode].erase(addr);
+
+	if(res >= 0) memo[mode][addr] = res;
+	return res;
+}
+
+static long funcCycles(unsigned addr) // called function: to its "ret", "sei" inside does not matter
+{
+	static std::map<unsigned, long> calls;
+	static std::set<unsigned> active;
+
+	auto it = calls.find(addr);
+	if(it != calls.end()) return it -> second;
+
+	if(active.count(addr))
+	{
+		error = "recursion";
+		return CYC_UNBOUND;
+	}
+
+	active.insert(addr);
+	long res = worst(addr, MODE_TOTAL);
+	active.erase(addr);
+
+	calls[addr] = res;
+	return res;
+}
+
+/*********************************************************************************/
+
+static void usage()
+{
+	fprintf(stderr, "usage: isr_latency [-b cycles] [-u vector] [-f func:cycles] [-d avr-objdump] [-i file.lss] [firmware.elf]\n");
+}
+
+int main(int argc, char **argv)
+{
+	long budget = 25;
+	int usb_vector = 1;
+	std::string objdump = "avr-objdump";
+	std::string lss;
+	std::vector<std::pair<std::string, long>> funcs; // hot functions with own budget
+	const char *colon;
+	int opt;
+
+	while((opt = getopt(argc, argv, "b:u:f:d:i:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b': budget = atol(optarg); break;
+			case 'u': usb_vector = atoi(optarg); break;
+			case 'f':
+				if(!(colon = strchr(optarg, ':')))
+				{
+					usage();
+					return 2;
+				}
+				funcs.push_back(std::make_pair(std::string(optarg, colon - optarg), atol(colon + 1)));
+				break;
+			case 'd': objdump = optarg; break;
+			case 'i': lss = optarg; break;
+			default: usage(); return 2;
+		}
+	}
+
+	FILE *f;
+
+	if(!lss.empty()) f = fopen(lss.c_str(), "r");
+	else if(optind == argc - 1) f = popen((objdump + " -d '" + argv[optind] + "'").c_str(), "r");
+	else
+	{
+		usage();
+		return 2;
+	}
+
+	if(!f)
+	{
+		perror("disassembly");
+		return 2;
+	}
+
+	bool ok = loadDisasm(f);
+
+	if(lss.empty()) pclose(f);
+	else fclose(f);
+
+	if(!ok)
+	{
+		fprintf(stderr, "no code in disassembly\n");
+		return 2;
+	}
+
+	bool fail = false;
+	char usb_name[32];
+
+	snprintf(usb_name, sizeof(usb_name), "__vector_%d", usb_vector);
+
+	printf("budget %ld cycles, entry %d cycles (response + vector jmp)\n\n", budget, CYC_RESPONSE + CYC_VECTOR);
+	printf("%-28s %10s %10s\n", "ISR", "to sei", "total");
+
+	for(const auto &s : symbols)
+	{
+		if(s.first.compare(0, 9, "__vector_") || (s.first == "__vector_default") || (s.first == usb_name)) continue;
+
+		long to_sei, total;
+
+		error.clear();
+		to_sei = worst(s.second, MODE_SEI);
+
+		printf("%-28s ", s.first.c_str());
+
+		if(to_sei < 0)
+		{
+			printf("%10s %10s  FAIL: %s\n", "?", "?", error.c_str());
+			fail = true;
+			continue;
+		}
+
+		to_sei += CYC_RESPONSE + CYC_VECTOR;
+		printf("%10ld ", to_sei);
+
+		error.clear();
+		total = worst(s.second, MODE_TOTAL); // interrupts are enabled after "sei": not checked
+
+		if(total < 0) printf("%10s  (%s)", "?", error.c_str());
+		else printf("%10ld", total + CYC_RESPONSE + CYC_VECTOR);
+
+		printf("%s\n", (to_sei > budget) ? "  FAIL: over budget" : "");
+		if(to_sei > budget) fail = true;
+	}
+
+// "cli" sections (ATOMIC_BLOCK, 16 bit timer access): to "sei" or SREG restore, inside ISR after its "sei" - to "sei" or "reti"
+	printf("\n%-28s %10s\n", "cli section", "blocked");
+
+	for(const auto &c : code)
+	{
+		if(c.second.op != "cli") continue;
+
+		const char *func = "?";
+		unsigned best = 0;
+
+		for(const auto &s : symbols)
+			if((s.second <= c.first) && (s.second >= best))
+			{
+				best = s.second;
+				func = s.first.c_str();
+			}
+
+		bool in_isr = !strncmp(func, "__vector_", 9);
+		char name[64];
+		long blk;
+
+		if(in_isr && (!strcmp(func, "__vector_default") || !strcmp(func, usb_name))) continue;
+
+		snprintf(name, sizeof(name), "%s+0x%x", func, c.first - best);
+		printf("%-28s ", name);
+
+		error.clear();
+		blk = worst(c.first + 2, in_isr ? MODE_SEI : MODE_CLI); // "pop" and "out SREG" of epilogue keep I = 0
+
+		if(blk < 0)
+		{
+			printf("%10s  FAIL: %s\n", "?", error.c_str());
+			fail = true;
+			continue;
+		}
+
+		blk += 1; // cli itself
+		printf("%10ld%s\n", blk, (blk > budget) ? "  FAIL: over budget" : "");
+		if(blk > budget) fail = true;
+	}
+
+// hot functions out of ISRs (decoders of every frame): whole call to "ret"
+	if(!funcs.empty()) printf("\n%-28s %10s %10s\n", "function", "cycles", "budget");
+
+	for(const auto &fn : funcs)
+	{
+		auto s = symbols.find(fn.first);
+		long cyc;
+
+		printf("%-28s ", fn.first.c_str());
+
+		if(s == symbols.end())
+		{
+			printf("%10s %10ld  FAIL: no symbol (inlined?)\n", "?", fn.second);
+			fail = true;
+			continue;
+		}
+
+		error.clear();
+		cyc = funcCycles(s -> second);
+
+		if(cyc < 0)
+		{
+			printf("%10s %10ld  FAIL: %s\n", "?", fn.second, error.c_str());
+			fail = true;
+			continue;
+		}
+
+		cyc += CYC_CALL;
+		printf("%10ld %10ld%s\n", cyc, fn.second, (cyc > fn.second) ? "  FAIL: over budget" : "");
+		if(cyc > fn.second) fail = true;
+	}
+
+	printf("\n%s\n", fail ? "FAIL" : "OK");
+	return fail ? 1 : 0;
+}
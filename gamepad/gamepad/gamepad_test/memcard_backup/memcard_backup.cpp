@@ -0,0 +1,179 @@
+/*********************************************************************************/
+/* backup and restore of PS memory card through adapter (PS_MEMCARD, see         */
+/* "memcard.h"): vendor requests go by usbdevfs, no libusb is required           */
+/*                                                                               */
+/* build (options must be the same as for firmware, see "fw_host.h"):           */
+/*		g++ -O2 -std=c++17 -I../host -o memcard_backup memcard_backup.cpp        */
+/* run (needs access to /dev/bus/usb of adapter):                                */
+/*		memcard_backup [-s sectors] read card.mcr   - whole card (128 KB) to file */
+/*		memcard_backup [-s sectors] write card.mcr  - file to card               */
+/*	-s - sectors per request (default 64, up to 511: "wLength" is 16 bit)        */
+/*                                                                               */
+/* throughput (KB/s) is printed at the end: USB low speed control transfer goes  */
+/* 8 bytes per packet, card sectors are read by MC meanwhile; short read (card   */
+/* is slower) is asked again from next sector, write waits end of MC_BUSY        */
+/*********************************************************************************/
+
+#include "fw_host.h"
+#include "fw_usb.h"
+
+#include <vector>
+
+#include <time.h>
+
+volatile uint16_t TCNT1; // required by firmware headers, not used here
+
+static double nowUs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool readStatus(int fd, mc_status_t *st)
+{
+	if(fwControl(fd, FW_RQ_IN, VENDOR_RQ_MC_STATUS, 0, st, sizeof(*st)) == sizeof(*st)) return true;
+
+	fprintf(stderr, "status: %s\n", strerror(errno));
+	return false;
+}
+
+static void printStatus(int fd)
+{
+	static const char *names[] = {"ok", "no card", "bad checksum", "bad sector", "cancelled", "busy"};
+	mc_status_t st;
+
+	if(!readStatus(fd, &st)) return;
+
+	fprintf(stderr, "card: %s, sector %u, end byte 0x%02X\n", (st.result < 6) ? names[st.result] : "?", st.sector, st.end);
+}
+
+static int transfer(int fd, bool write_card, int sector, uchar *data, int len) // whole request, or -1
+{
+	mc_status_t st;
+	int done = 0, res;
+
+	while(done < len)
+	{
+		res = fwControl(fd, write_card ? FW_RQ_OUT : FW_RQ_IN, write_card ? VENDOR_RQ_MC_WRITE : VENDOR_RQ_MC_READ,
+						sector + done / MC_SECTOR, data + done, len - done);
+
+		if(res < 0) return -1;
+
+		done += res;
+
+		if(write_card || (done < len)) // write: last sectors go to card after status stage, read: card is slower
+		{
+			do
+			{
+				if(!readStatus(fd, &st)) return -1;
+				if(st.result == MC_BUSY) usleep(1000);
+			}
+			while(write_card && (st.result == MC_BUSY));
+
+			if((st.result != MC_OK) && (st.result != MC_BUSY)) return -1;
+			if(write_card && (done < len)) return -1;
+		}
+	}
+
+	return done;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: memcard_backup [-s sectors] read|write file\n");
+}
+
+int main(int argc, char **argv)
+{
+	int per_rq = 64;
+	int opt;
+
+	while((opt = getopt(argc, argv, "s:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 's': per_rq = atoi(optarg); break;
+			default: usage(); return 2;
+		}
+	}
+
+	if((optind != argc - 2) || (per_rq < 1) || (per_rq > 0xFFFF / MC_SECTOR))
+	{
+		usage();
+		return 2;
+	}
+
+	bool write_card = !strcmp(argv[optind], "write");
+
+	if(!write_card && strcmp(argv[optind], "read"))
+	{
+		usage();
+		return 2;
+	}
+
+	std::vector<uchar> card(MC_SECTORS * MC_SECTOR);
+	const char *path = argv[optind + 1];
+	FILE *f;
+
+	if(write_card)
+	{
+		f = fopen(path, "rb");
+
+		if(!f || (fread(card.data(), 1, card.size(), f) != card.size()))
+		{
+			fprintf(stderr, "%s: must be %zu bytes\n", path, card.size());
+			if(f) fclose(f);
+			return 1;
+		}
+
+		fclose(f);
+	}
+
+	int fd = fwOpenAdapter();
+
+	if(fd < 0) return 1;
+
+	double start = nowUs();
+
+	for(int sector = 0; sector < MC_SECTORS; sector += per_rq)
+	{
+		int n = (MC_SECTORS - sector < per_rq) ? MC_SECTORS - sector : per_rq;
+		int len = n * MC_SECTOR;
+		errno = 0;
+
+		int res = transfer(fd, write_card, sector, &card[sector * MC_SECTOR], len);
+
+		if(res != len)
+		{
+			fprintf(stderr, "sectors %d..%d: %s\n", sector, sector + n - 1, errno ? strerror(errno) : "card error");
+			printStatus(fd);
+			close(fd);
+			return 1;
+		}
+
+		fprintf(stderr, "\r%d / %d sectors", sector + n, MC_SECTORS);
+	}
+
+	double sec = (nowUs() - start) / 1e6;
+
+	fprintf(stderr, "\n%zu bytes in %.2f s: %.2f KB/s\n", card.size(), sec, card.size() / 1024.0 / sec);
+	close(fd);
+
+	if(!write_card)
+	{
+		f = fopen(path, "wb");
+
+		if(!f || (fwrite(card.data(), 1, card.size(), f) != card.size()))
+		{
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			if(f) fclose(f);
+			return 1;
+		}
+
+		fclose(f);
+	}
+
+	return 0;
+}
@@ -0,0 +1,265 @@
+/*********************************************************************************/
+/* decoder of binary trace and raw frame stream from USART (TRACE, STREAM,       */
+/* see "trace.h")                                                                */
+/*                                                                               */
+/* build (options must be the same as for firmware, see "fw_host.h"):           */
+/*		g++ -O2 -std=c++17 -I../host -o trace_decode trace_decode.cpp            */
+/* run:                                                                          */
+/*		trace_decode [-s] [-b baud] /dev/ttyUSB0 - read serial port (TRACE_BAUD) */
+/*	baud of firmware is derived from F_CPU and is not standard for most clocks   */
+/*	(1.5 M at 12 MHz): port is set by termios2 (BOTHER), USB-UART must take it  */
+/*		trace_decode [-s] -f capture.bin        - read raw capture ("-" - stdin) */
+/*	-s - stream frames only (for recording), without trace records               */
+/*                                                                               */
+/* one line per record: time in us (timer 1 of MC, unwrapped), event, payload;   */
+/* one line per frame: time, "ps", "ps_tap" or "sega", seq, data bytes in hex;   */
+/* byte stream is resynced by crc, skipped bytes and lost frames are counted     */
+/*********************************************************************************/
+
+#include "fw_host.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h> /* termios2: any baud, not only B* constants */
+#include <unistd.h>
+
+#define TICK_US		(TICK_T1_PRESC * 1000000.0 / F_CPU)	/* MC timer 1 tick */
+
+volatile uint16_t TCNT1; // required by firmware headers, not used here
+
+static volatile sig_atomic_t stop = 0;
+
+static void onSignal(int)
+{
+	stop = 1;
+}
+
+static uchar crcIbutton(uchar crc, uchar data) // the same as "_crc_ibutton_update" of avr-libc
+{
+	crc ^= data;
+
+	for(int i = 0; i < 8; i++)
+		crc = (crc & 0x01) ? (crc >> 1) ^ 0x8C : (crc >> 1);
+
+	return crc;
+}
+
+static int packetLen(uchar id) // bytes after id without crc, -1 - unknown id
+{
+	switch(id)
+	{
+		case STREAM_ID_PS:		return STREAM_HDR + STREAM_PS_LEN;
+		case STREAM_ID_SEGA:	return STREAM_HDR + STREAM_SEGA_LEN;
+		case STREAM_ID_PS_TAP:	return STREAM_HDR + STREAM_PS_TAP_LEN;
+		default:				return (id < 0x80) ? TRACE_REC_DATA : -1;
+	}
+}
+
+static const char *eventName(uchar id)
+{
+	switch(id)
+	{
+		case TRACE_ID_BOOT:		return "boot";
+		case TRACE_ID_LOST:		return "lost";
+		case TRACE_ID_SETUP:	return "setup";
+		case TRACE_ID_POLL:		return "poll";
+		case TRACE_ID_UNPLUG:	return "unplug";
+		case TRACE_ID_REPORT:	return "report";
+		case TRACE_ID_BAD_FRAME:	return "bad_frame";
+		case TRACE_ID_SEL_END:	return "sel_end";
+		default:				return "?";
+	}
+}
+
+struct decoder_t
+{
+	std::vector<uchar> buf;
+	uint64_t records;
+	uint64_t frames;
+	uint64_t frames_lost; // gaps of stream seq
+	uint64_t skipped; // bytes thrown away while resync
+	uchar last_seq;
+	bool stream_only;
+	double time_us;
+	uint16_t last_tick;
+	bool started;
+};
+
+static void onPacket(decoder_t *d, const uchar *pkt, int len)
+{
+	uchar id = pkt[0];
+	uint16_t tick = pkt[2] | (pkt[3] << 8);
+
+	if(!d -> started || (id == TRACE_ID_BOOT)) d -> time_us = tick * TICK_US; // MC is reset: time goes from its stamp
+	else d -> time_us += (uint16_t)(tick - d -> last_tick) * TICK_US; // wrap ~ 262 ms at 16 MHz, records go faster
+
+	d -> last_tick = tick;
+	d -> started = true;
+
+	if(id >= 0x80) // stream frame: id, seq, time, data
+	{
+		if(d -> frames) d -> frames_lost += (uchar)(pkt[1] - d -> last_seq - 1);
+
+		d -> last_seq = pkt[1];
+		d -> frames++;
+
+		printf("%12.1f  %-8s %3u ", d -> time_us, (id == STREAM_ID_SEGA) ? "sega" : (id == STREAM_ID_PS) ? "ps" : "ps_tap", pkt[1]);
+		for(int i = 1 + STREAM_HDR; i <= len; i++) printf(" %02X", pkt[i]);
+		printf("\n");
+		return;
+	}
+
+	d -> records++;
+
+	if(!d -> stream_only) printf("%12.1f  %-8s 0x%02X (%u)\n", d -> time_us, eventName(id), pkt[1], pkt[1]);
+}
+
+static void decode(decoder_t *d, const uchar *data, size_t len)
+{
+	size_t pos = 0;
+
+	d -> buf.insert(d -> buf.end(), data, data + len);
+
+	while(d -> buf.size() - pos >= 2)
+	{
+		int n = packetLen(d -> buf[pos]);
+
+		if(n < 0)
+		{
+			pos++;
+			d -> skipped++;
+			continue;
+		}
+
+		if(d -> buf.size() - pos < (size_t)n + 2) break; // wait rest of packet
+
+		uchar crc = 0;
+
+		for(int i = 0; i <= n; i++) crc = crcIbutton(crc, d -> buf[pos + i]);
+
+		if(crc != d -> buf[pos + n + 1])
+		{
+			pos++;
+			d -> skipped++;
+			continue;
+		}
+
+		onPacket(d, &d -> buf[pos], n);
+		pos += n + 2;
+	}
+
+	d -> buf.erase(d -> buf.begin(), d -> buf.begin() + pos);
+}
+
+static int openSerial(const char *path, long baud)
+{
+	struct termios2 tio;
+	int fd;
+
+	if(baud <= 0)
+	{
+		fprintf(stderr, "baud %ld is not supported\n", baud);
+		return -1;
+	}
+
+	fd = open(path, O_RDONLY | O_NOCTTY);
+
+	if(fd < 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if(ioctl(fd, TCGETS2, &tio) < 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+// raw 8N1 (as "cfmakeraw") with baud in numbers:
+	tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+	tio.c_oflag &= ~OPOST;
+	tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+	tio.c_cflag &= ~(CSIZE | PARENB | CBAUD | (CBAUD << IBSHIFT));
+	tio.c_cflag |= CS8 | BOTHER | (BOTHER << IBSHIFT) | CLOCAL | CREAD;
+	tio.c_ispeed = baud;
+	tio.c_ospeed = baud;
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+
+	if(ioctl(fd, TCSETS2, &tio) < 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	ioctl(fd, TCFLSH, TCIFLUSH);
+	return fd;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: trace_decode [-s] [-b baud] /dev/ttyX\n"
+					"       trace_decode [-s] -f capture.bin (\"-\" - stdin)\n"
+					"  -s  stream frames only\n");
+}
+
+int main(int argc, char **argv)
+{
+	long baud = TRACE_BAUD;
+	const char *file = NULL;
+	bool stream_only = false;
+	int opt, fd;
+
+	while((opt = getopt(argc, argv, "b:f:sh")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b': baud = atol(optarg); break;
+			case 'f': file = optarg; break;
+			case 's': stream_only = true; break;
+			default: usage(); return 2;
+		}
+	}
+
+	if(file) fd = strcmp(file, "-") ? open(file, O_RDONLY) : 0;
+	else if(optind == argc - 1) fd = openSerial(argv[optind], baud);
+	else
+	{
+		usage();
+		return 2;
+	}
+
+	if(fd < 0)
+	{
+		if(file) fprintf(stderr, "%s: %s\n", file, strerror(errno));
+		return 1;
+	}
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	decoder_t d = decoder_t();
+	d.stream_only = stream_only;
+	uchar buf[256];
+	ssize_t len;
+
+	while(!stop && ((len = read(fd, buf, sizeof(buf))) > 0)) decode(&d, buf, len);
+
+	fprintf(stderr, "%llu records, %llu frames (%llu lost), %llu bytes skipped\n", (unsigned long long)d.records,
+			(unsigned long long)d.frames, (unsigned long long)d.frames_lost, (unsigned long long)d.skipped);
+
+	if(fd) close(fd);
+	return 0;
+}
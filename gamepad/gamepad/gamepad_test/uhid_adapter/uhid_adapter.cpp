@@ -0,0 +1,386 @@
+/*********************************************************************************/
+/* virtual adapter for Linux: one /dev/uhid device per player with VID/PID from  */
+/* "desc_dev" and report descriptor "usbDescriptorHidReport" of firmware,        */
+/* reports are built by firmware code ("report.c", "remap.c", "dpad.c") from     */
+/* scripted controller input, so evdev, SDL and games see exactly what MC sends  */
+/*                                                                               */
+/* build (options must be the same as for firmware, see "fw_host.h"):           */
+/*		gcc -c -O2 -I../host [-DREPORT_STAMP] ../../report.c ../../remap.c ../../dpad.c */
+/*		g++ -O2 -std=c++17 -I../host [-DREPORT_STAMP] -o uhid_adapter uhid_adapter.cpp report.o remap.o dpad.o */
+/* run (needs access to /dev/uhid):                                              */
+/*		uhid_adapter [-l] [-i idle] script                                       */
+/*	-l - repeat script, -i - report period in 4 ms steps like "delay_idle"       */
+/*	(default INIT_IDLE_TIME): MC sends new report once per "idle + 1" steps      */
+/*                                                                               */
+/* script - one event per line, "#" - comment:                                   */
+/*		time_ms player ps   b1 b2 .. b8   - PS answer bytes 1..8 after 0xFF:     */
+/*										    ID, 0x5A, DAT1, DAT2, RJX, RJY, LJX, LJY */
+/*		time_ms player sega s0 s1 .. s7   - SEGA port PIN in SEL states 0..7     */
+/*		time_ms player none               - controller is unplugged              */
+/*	"time_ms" - from start of script, data bytes are hex, see "example.txt"      */
+/*********************************************************************************/
+
+#include "fw_host.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/uhid.h>
+
+#define SRC_NONE	0
+#define SRC_PS		1
+#define SRC_SEGA	2
+
+#define SRC_BYTES	8 /* PS: frame bytes 1..8, SEGA: 8 SEL states */
+
+#define SCRIPT_TAIL_US	1000000.0 /* script ends (or repeats) in 1 s after last event */
+
+volatile uint16_t TCNT1; // emulated MC timer 1 for report stamps
+#if USB_COUNT_SOF
+	volatile uchar usbSofCount; // one SOF per ms
+#endif
+
+struct event_t
+{
+	double t_ms;
+	int player;
+	int src;
+	uchar data[SRC_BYTES];
+};
+
+struct player_t
+{
+	int fd;
+	int src;
+	uchar data[SRC_BYTES];
+	uchar report[REPORT_SIZE];
+	uchar seq;
+	uchar index; // player of SOCD state in "dpad.c"
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void onSignal(int)
+{
+	stop = 1;
+}
+
+static double nowUs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool loadScript(const char *path, std::vector<event_t> &script)
+{
+	FILE *f = fopen(path, "r");
+	char line[256];
+	int num = 0;
+
+	if(!f)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	while(fgets(line, sizeof(line), f))
+	{
+		char *end = strchr(line, '#');
+		char type[8];
+		unsigned int b[SRC_BYTES];
+		event_t ev = event_t();
+		int n;
+
+		num++;
+		if(end) *end = 0;
+
+		n = sscanf(line, "%lf %d %7s %x %x %x %x %x %x %x %x", &ev.t_ms, &ev.player, type,
+				   &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7]);
+
+		if(n <= 0) continue; // empty line
+
+		if(n >= 3 && !strcmp(type, "none")) ev.src = SRC_NONE;
+		else if(n == 3 + SRC_BYTES && !strcmp(type, "ps")) ev.src = SRC_PS;
+		else if(n == 3 + SRC_BYTES && !strcmp(type, "sega")) ev.src = SRC_SEGA;
+		else
+		{
+			fprintf(stderr, "%s:%d: bad event\n", path, num);
+			fclose(f);
+			return false;
+		}
+
+		if((ev.player < 0) || (ev.player >= PLAYERS))
+		{
+			fprintf(stderr, "%s:%d: player must be 0..%d\n", path, num, PLAYERS - 1);
+			fclose(f);
+			return false;
+		}
+
+		for(int i = 0; i < SRC_BYTES; i++) ev.data[i] = (ev.src == SRC_NONE) ? 0 : b[i];
+
+		if(!script.empty() && (ev.t_ms < script.back().t_ms))
+		{
+			fprintf(stderr, "%s:%d: time goes back\n", path, num);
+			fclose(f);
+			return false;
+		}
+
+		script.push_back(ev);
+	}
+
+	fclose(f);
+	return true;
+}
+
+static int uhidCreate(int player)
+{
+	int fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+	struct uhid_event ev;
+
+	if(fd < 0)
+	{
+		fprintf(stderr, "/dev/uhid: %s\n", strerror(errno));
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+
+	snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "ss_gamepad (uhid) player %d", player + 1);
+	snprintf((char *)ev.u.create2.phys, sizeof(ev.u.create2.phys), "uhid_adapter/input%d", player);
+
+// the same IDs as in device descriptor of MC:
+	ev.u.create2.bus = BUS_USB;
+	ev.u.create2.vendor = desc_dev[8] | (desc_dev[9] << 8);
+	ev.u.create2.product = desc_dev[10] | (desc_dev[11] << 8);
+	ev.u.create2.version = desc_dev[12] | (desc_dev[13] << 8);
+	ev.u.create2.country = 0;
+
+	ev.u.create2.rd_size = sizeof(usbDescriptorHidReport);
+	memcpy(ev.u.create2.rd_data, usbDescriptorHidReport, sizeof(usbDescriptorHidReport));
+
+	if(write(fd, &ev, sizeof(ev)) != sizeof(ev))
+	{
+		fprintf(stderr, "/dev/uhid: can not create device: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void uhidDestroy(int fd)
+{
+	struct uhid_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+
+	if(write(fd, &ev, sizeof(ev)) < 0) {} // device goes away with fd anyway
+	close(fd);
+}
+
+static void uhidEvents(int fd) // feature report (config block) lives in EEPROM of MC: not emulated, answer error
+{
+	struct uhid_event ev, ans;
+
+	while(read(fd, &ev, sizeof(ev)) > 0)
+	{
+		memset(&ans, 0, sizeof(ans));
+
+		if(ev.type == UHID_GET_REPORT)
+		{
+			ans.type = UHID_GET_REPORT_REPLY;
+			ans.u.get_report_reply.id = ev.u.get_report.id;
+			ans.u.get_report_reply.err = EIO;
+		}
+		else if(ev.type == UHID_SET_REPORT)
+		{
+			ans.type = UHID_SET_REPORT_REPLY;
+			ans.u.set_report_reply.id = ev.u.set_report.id;
+			ans.u.set_report_reply.err = EIO;
+		}
+		else continue; // START, OPEN, CLOSE, OUTPUT
+
+		if(write(fd, &ans, sizeof(ans)) < 0) {}
+	}
+}
+
+static void buildReport(player_t *p) // the same calls as in "pollPS" ("main.c") and report loop of "sega_only.c"
+{
+	uchar frame[9];
+	stamp_t stamp;
+
+	stampTake(&stamp);
+
+	if(p -> src == SRC_PS)
+	{
+		frame[0] = 0xFF;
+		memcpy(frame + 1, p -> data, SRC_BYTES);
+
+		uchar res = psCheckFrame(frame);
+
+		if(res == PS_FRAME_OK) buildPSReport(p -> report, frame, p -> index);
+		else if(res == PS_FRAME_ABSENT) buildNeutralReport(p -> report); // bad frame: last good report is held
+	}
+	else if(p -> src == SRC_SEGA)
+	{
+		uchar gp_state[2][SRC_BYTES]; // decoder takes both ports: 2nd is absent
+		uchar btn[2][2];
+
+		memset(gp_state[1], SEGA_PIN_MASK, SRC_BYTES);
+		for(int i = 0; i < SRC_BYTES; i++) gp_state[0][i] = p -> data[i] & SEGA_PIN_MASK;
+
+		segaDecode(gp_state[0], btn[0]);
+
+		if(segaPresent(gp_state[0])) buildSegaReport(p -> report, btn[0], p -> index);
+		else buildNeutralReport(p -> report);
+	}
+	else buildNeutralReport(p -> report);
+
+	stampReport(p -> report, ++p -> seq, &stamp);
+}
+
+static void sendReport(player_t *p)
+{
+	struct uhid_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_INPUT2;
+	ev.u.input2.size = REPORT_SIZE;
+	memcpy(ev.u.input2.data, p -> report, REPORT_SIZE);
+
+	if(write(p -> fd, &ev, sizeof(ev)) < 0) fprintf(stderr, "/dev/uhid: %s\n", strerror(errno));
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: uhid_adapter [-l] [-i idle] script\n"
+					"  -l  repeat script\n"
+					"  -i  report period in %d us steps (default %d)\n", STEP_IDLE_US, INIT_IDLE_TIME);
+}
+
+int main(int argc, char **argv)
+{
+	bool loop = false;
+	int idle = INIT_IDLE_TIME;
+	int opt;
+
+	while((opt = getopt(argc, argv, "li:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 'l': loop = true; break;
+			case 'i': idle = atoi(optarg); break;
+			default: usage(); return 2;
+		}
+	}
+
+	if((optind != argc - 1) || (idle < 0) || (idle > 255))
+	{
+		usage();
+		return 2;
+	}
+
+	std::vector<event_t> script;
+
+	if(!loadScript(argv[optind], script)) return 1;
+	if(script.empty())
+	{
+		fprintf(stderr, "%s: no events\n", argv[optind]);
+		return 1;
+	}
+
+	remapCompile(NULL); // default config: identity
+	dpadCompile(DPAD_MODE_INIT);
+
+	player_t players[PLAYERS];
+
+	for(int i = 0; i < PLAYERS; i++)
+	{
+		memset(&players[i], 0, sizeof(players[i]));
+		buildNeutralReport(players[i].report);
+		players[i].index = i;
+
+		players[i].fd = uhidCreate(i);
+
+		if(players[i].fd < 0)
+		{
+			while(i--) uhidDestroy(players[i].fd);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	long period_ns = (idle + 1) * STEP_IDLE_US * 1000L;
+	double start = nowUs();
+	double script_start = start;
+	size_t next = 0;
+	struct timespec wake;
+
+	clock_gettime(CLOCK_MONOTONIC, &wake);
+
+	printf("%d players, report every %ld us, ID %04x:%04x, report descriptor %zu bytes\n", PLAYERS, period_ns / 1000,
+		   FW_VENDOR_ID, FW_DEVICE_ID, sizeof(usbDescriptorHidReport));
+
+	while(!stop)
+	{
+		double t_us = nowUs();
+
+	// apply events which time has come:
+		while((next < script.size()) && (script[next].t_ms * 1000 <= t_us - script_start))
+		{
+			player_t *p = &players[script[next].player];
+
+			p -> src = script[next].src;
+			memcpy(p -> data, script[next].data, SRC_BYTES);
+			next++;
+		}
+
+		if((next >= script.size()) && (t_us - script_start >= script.back().t_ms * 1000 + SCRIPT_TAIL_US))
+		{
+			if(!loop) break;
+
+			next = 0;
+			script_start = t_us;
+		}
+
+	// MC time for stamps:
+		TCNT1 = (uint16_t)((t_us - start) / (TICK_T1_PRESC * 1000000.0 / F_CPU));
+#if USB_COUNT_SOF
+		usbSofCount = (uchar)((t_us - start) / 1000);
+#endif
+
+		for(int i = 0; i < PLAYERS; i++)
+		{
+			uhidEvents(players[i].fd);
+			buildReport(&players[i]);
+			sendReport(&players[i]);
+		}
+
+		wake.tv_nsec += period_ns;
+		while(wake.tv_nsec >= 1000000000L)
+		{
+			wake.tv_nsec -= 1000000000L;
+			wake.tv_sec++;
+		}
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+	}
+
+	for(int i = 0; i < PLAYERS; i++) uhidDestroy(players[i].fd);
+	return 0;
+}
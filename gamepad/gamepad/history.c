@@ -0,0 +1,149 @@
+#include "history.h"
+
+#if defined(STICKY_PRESS) || defined(HISTORY)
+
+#include <avr/io.h>
+#include <string.h>
+
+#include "dpad.h"
+
+#define HIST_BTN_LEN 2 /* buttons of report, see BTN in "report_fields.h" */
+
+typedef char hist_btn_check[(sizeof(((report_layout_t *)0) -> BTN) == HIST_BTN_LEN) ? 1 : -1];
+
+#ifdef STICKY_PRESS
+	uchar sticky_btn[PLAYERS][HIST_BTN_LEN]; // pressed in samples since last sent report
+	uint16_t sticky_dirs = 0; // report bits of directions: their taps are already cleaned in report
+#endif
+
+#ifdef HISTORY
+	typedef char hist_ring_check[((HISTORY_RECORDS & (HISTORY_RECORDS - 1)) == 0) ? 1 : -1]; // power of 2
+	typedef char hist_len_check[(sizeof(hist_head_t) + HISTORY_RECORDS * sizeof(hist_rec_t) <= 255) ? 1 : -1]; // "uchar" length
+	
+	hist_rec_t hist_buf[HISTORY_RECORDS];
+	uchar hist_head = 0; // next record to write
+	uchar hist_count = 0;
+	uchar hist_last[PLAYERS][HIST_BTN_LEN]; // buttons of last sample
+	uchar hist_lost = 0;
+	
+	// VENDOR_RQ_HISTORY transfer:
+		hist_head_t hist_rd_head;
+		uchar hist_rd = 0; // transfer goes: ring is stopped
+		uchar hist_rd_pos;
+		uchar hist_rd_len;
+	
+static void historyAdd(uchar info, const uchar *btn, uint16_t time)
+{
+	hist_rec_t *rec;
+	
+	if(hist_rd)
+	{
+		if(hist_lost != 0xFF) hist_lost++; // head of this read is on wire already: count goes in next read
+		return;
+	}
+	
+	rec = &hist_buf[hist_head];
+	rec -> time = time;
+	rec -> info = info;
+	rec -> btn[0] = btn[0];
+	rec -> btn[1] = btn[1];
+	
+	hist_head = (hist_head + 1) & (HISTORY_RECORDS - 1);
+	if(hist_count < HISTORY_RECORDS) hist_count++;
+}
+#endif
+
+void historySample(uchar player, const uchar *report, uint16_t time)
+{
+	const uchar *btn = report + REPORT_OFS(BTN);
+	
+#ifdef STICKY_PRESS
+	sticky_btn[player][0] |= btn[0] & ~(uchar)sticky_dirs;
+	sticky_btn[player][1] |= btn[1] & ~(uchar)(sticky_dirs >> 8);
+#endif
+	
+#ifdef HISTORY
+	if((btn[0] != hist_last[player][0]) | (btn[1] != hist_last[player][1]))
+	{
+		hist_last[player][0] = btn[0];
+		hist_last[player][1] = btn[1];
+		historyAdd(player, btn, time);
+	}
+#else
+	(void)time;
+#endif
+}
+
+uchar *historySend(uchar player, const uchar *report) // V-USB copies report at once: one buffer for both endpoints
+{
+	static uchar tx[REPORT_SIZE];
+	uchar *btn = tx + REPORT_OFS(BTN);
+	
+	memcpy(tx, report, REPORT_SIZE);
+	
+#ifdef STICKY_PRESS
+	btn[0] |= sticky_btn[player][0];
+	btn[1] |= sticky_btn[player][1];
+	sticky_btn[player][0] = 0;
+	sticky_btn[player][1] = 0;
+	dpad_sticky[player] = 0;
+#endif
+	
+#ifdef HISTORY
+	historyAdd(player | HIST_SENT, btn, TCNT1);
+#endif
+	
+	return tx;
+}
+
+#ifdef HISTORY
+usbMsgLen_t historySetup(usbRequest_t *rq)
+{
+	hist_rd_head.count = hist_count;
+	hist_rd_head.lost = hist_lost;
+	hist_lost = 0;
+	
+	hist_rd = 1;
+	hist_rd_pos = 0;
+	hist_rd_len = sizeof(hist_head_t) + hist_count * sizeof(hist_rec_t);
+	
+	if(rq -> wLength.word < hist_rd_len) hist_rd_len = rq -> wLength.word;
+	
+	return USB_NO_MSG; // call "usbFunctionRead"
+}
+
+void historyCancel()
+{
+	hist_rd = 0;
+}
+
+uchar historyOwnsData()
+{
+	return hist_rd;
+}
+
+uchar historyRead(uchar *data, uchar len)
+{
+	uchar first = (hist_head - hist_count) & (HISTORY_RECORDS - 1); // oldest record
+	uchar pos, i;
+	
+	if(len > hist_rd_len - hist_rd_pos) len = hist_rd_len - hist_rd_pos;
+	
+	for(i = 0; i < len; i++)
+	{
+		pos = hist_rd_pos++;
+		
+		if(pos < sizeof(hist_head_t)) data[i] = ((uchar *)&hist_rd_head)[pos];
+		else
+		{
+			pos -= sizeof(hist_head_t);
+			data[i] = ((uchar *)&hist_buf[(first + pos / sizeof(hist_rec_t)) & (HISTORY_RECORDS - 1)])[pos % sizeof(hist_rec_t)];
+		}
+	}
+	
+	if(hist_rd_pos >= hist_rd_len) hist_rd = 0; // ring goes on
+	return len;
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include "defines.h"
+
+#include <stdint.h>
+
+#include "usbdrv/usbdrv.h"
+#include "report.h"
+
+/*********************************************************************************/
+/* sticky press (STICKY_PRESS): controller is sampled every ~ 2 ms, host takes   */
+/* report every 10 ms or more, so tap between two sent reports is lost; buttons  */
+/* pressed in any sample since last sent report are added to report which goes  */
+/* to endpoint, then they are released ("historySample" / "historySend");       */
+/* directions are held before SOCD cleaning instead ("dpadClean"): report bits   */
+/* of them ("HISTORY_DIRS" after remap is compiled) are left out of sticky OR    */
+/*                                                                               */
+/* history (HISTORY): RAM ring of last HISTORY_RECORDS events - change of        */
+/* buttons in sample and every sent report - for "missed input" complaints;      */
+/* VENDOR_RQ_HISTORY gives "hist_head_t" and then records from oldest to newest, */
+/* ring stops while transfer goes ("lost" - events dropped while previous read)  */
+/* host: "gamepad_test/history_dump"                                             */
+/*********************************************************************************/
+
+#define HIST_PLAYER_MASK	0x03
+#define HIST_SENT			0x80 /* "btn" went to host, else - new buttons in sample */
+
+typedef struct
+{
+	uint16_t time;	// timer 1 cnt: when sample was latched or when report was given to V-USB
+	uchar info;		// player, HIST_SENT
+	uchar btn[2];	// buttons of report (after remap)
+} hist_rec_t;
+
+typedef struct
+{
+	uchar count;	// records after head
+	uchar lost;		// events dropped while previous read went, saturates
+} hist_head_t;
+
+#if (defined(STICKY_PRESS) || defined(HISTORY)) && !defined(FW_HOST)
+
+void historySample(uchar player, const uchar *report, uint16_t time); // every new report of player from controller
+uchar *historySend(uchar player, const uchar *report); // report for endpoint with sticky presses, call at "usbSetInterrupt"
+
+#define HISTORY_SAMPLE(player, report, time) historySample(player, report, time)
+#define HISTORY_SEND(player, report) historySend(player, report)
+
+#else
+
+#define HISTORY_SAMPLE(player, report, time)
+#define HISTORY_SEND(player, report) (report)
+
+#endif
+
+#if defined(STICKY_PRESS) && !defined(FW_HOST)
+	extern uint16_t sticky_dirs;
+	#define HISTORY_DIRS(bits) sticky_dirs = (bits)
+#else
+	#define HISTORY_DIRS(bits)
+#endif
+
+#if defined(HISTORY) && !defined(FW_HOST)
+	// VENDOR_RQ_HISTORY, call from "usbFunctionSetup/Read":
+		usbMsgLen_t historySetup(usbRequest_t *rq);
+		void historyCancel(); // any SETUP: previous control transfer is over
+		uchar historyOwnsData();
+		uchar historyRead(uchar *data, uchar len);
+#endif
+
+#endif /* HISTORY_H_ */
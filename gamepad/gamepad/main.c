@@ -3,22 +3,68 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
+#include <string.h>
 
 #include "usbdrv/usbdrv.h"
+#include "remap.h"
+#include "dpad.h"
+#include "config.h"
+#include "presence.h"
+#include "stamp.h"
+#include "report.h"
+#include "trace.h"
+#include "vendor.h"
+#include "memcard.h"
+#include "history.h"
+#include "sched.h"
 #include "descriptor.h"
 
 #ifdef DEBUG
 	#warning "DEBUG is enabled"
 #endif
 
-uchar report_buf[REPORT_SIZE] = {0x00, 0x00, 0x7F, 0x7F, 0x7F, 0x7F};
+uchar report_buf[PLAYERS][REPORT_SIZE]; // one report per interface: 1st player - EP1, 2nd - EP3, neutral on start
 
 // for USB:
 	uchar delay_idle = INIT_IDLE_TIME; // step - 4ms
 	uchar cnt_idle = 0;
 	uchar flag_idle = 0; // shows that USB idle time is over and we can send report
+	
+	uchar flag_report_rdy[PLAYERS] = {0, 0};
+	
+uchar flag_ctrl = 0; // chosen by CTRL pin on start: 1 - PS port is polled, 0 - SEGA (not in this firmware)
+uchar flag_poll_now = 0; // VENDOR_RQ_POLL_NOW has come: poll goes in next pass of main loop
 
 //uchar flag_report = 0; // shows that information from gamepad is ready to form like in descriptor
+
+// PS:
+	uchar ps_frame[PS_FRAME_MAX]; // answer of controller, see diagram, with multitap - PS_TAP_FRAME_LEN bytes
+	
+	port_state_t ps_port = {0, 0};
+	uint16_t ps_next_poll = 0; // in timer 1 ticks
+	
+	stamp_t ps_stamp; // when "ps_frame" was latched (REPORT_STAMP)
+	uchar report_seq = 0;
+	
+	ps_errors_t ps_err; // see VENDOR_RQ_PS_ERRORS
+	ps_errors_t ps_err_read; // copy for data stage: counters can be reset at once
+	uchar ps_bad_run = 0; // polls in a row with bad frames
+	uchar ps_players = 0; // players fed by PS port now, bit per player
+	
+	#ifdef PS_MULTITAP
+		port_state_t ps_slot[PS_TAP_SLOTS]; // presence of multitap slots, "backoff" is not used: slots go in one frame
+		uchar ps_bind[PS_TAP_SLOTS] = {PS_SLOT_FREE, PS_SLOT_FREE, PS_SLOT_FREE, PS_SLOT_FREE}; // player of slot, see "bindSlot"
+	#endif
+	
+	#ifdef SNES_PAD
+		uchar snes_data[PLAYERS][SNES_DATA_LEN];
+		port_state_t snes_port[PLAYERS];
+	#endif
+	
+	#ifdef PS_MOUSE
+		mouse_acc_t ps_mouse; // deltas of all polls since last mouse report
+		uchar mouse_report[MOUSE_REPORT_SIZE];
+	#endif
 	
 /*********************************************************************************/
 /* CLK ~ 7 kHz, issue data LSB on MISO and MOSI on falling edge, read on front   */
@@ -34,7 +80,7 @@ uchar report_buf[REPORT_SIZE] = {0x00, 0x00, 0x7F, 0x7F, 0x7F, 0x7F};
 /*		  ACK:									    |__|						 */
 /*********************************************************************************/
 
-USB_PUBLIC uchar usbFunctionDescriptor(usbRequest_t * rq)
+USB_PUBLIC usbMsgLen_t usbFunctionDescriptor(usbRequest_t * rq)
 {
 	if (rq->bRequest == USBRQ_GET_DESCRIPTOR)
 	{
@@ -52,23 +98,60 @@ USB_PUBLIC uchar usbFunctionDescriptor(usbRequest_t * rq)
 					usbMsgPtr = (usbMsgPtr_t)desc_prod_str;
 					return sizeof(desc_prod_str);
 				}
+				break;
+		#ifdef PS_MOUSE
+			case USBDESCR_HID_REPORT:
+				if(rq -> wIndex.bytes[0] == MOUSE_IFACE)
+				{
+					usbMsgPtr = (usbMsgPtr_t)desc_mouse_report;
+					return sizeof(desc_mouse_report);
+				}
+				usbMsgPtr = (usbMsgPtr_t)usbDescriptorHidReport;
+				return sizeof(usbDescriptorHidReport);
+		#endif
 		}
 	}
 	
 	return 0x00;
 }
 
-USB_PUBLIC uchar usbFunctionSetup(uchar data[8])
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8])
 {
 	usbRequest_t *rq = (usbRequest_t*)data;
 	
+	#ifdef PS_MEMCARD
+		mcardCancel(); // new SETUP: previous control transfer is over
+	#endif
+	
+	#ifdef HISTORY
+		historyCancel();
+	#endif
+	
 	if((rq -> bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS) // class request type
 	{    
+		TRACE_EVENT(TRACE_ID_SETUP, rq -> bRequest);
+		
 		switch (rq -> bRequest)
 		{
 			case USBRQ_HID_GET_REPORT:
-				usbMsgPtr = (usbMsgPtr_t)report_buf;
+				if(rq -> wValue.bytes[1] == HID_REPORT_FEATURE) return configSetup(rq); // call "usbFunctionRead"
+			
+				#ifdef PS_MOUSE
+					if(rq -> wIndex.bytes[0] == MOUSE_IFACE)
+					{
+						usbMsgPtr = (usbMsgPtr_t)mouse_report; // last sent: deltas are not drained here
+						return MOUSE_REPORT_SIZE;
+					}
+				#endif
+				
+				if(rq -> wIndex.bytes[0] < PLAYERS) // interface number <=> player
+					usbMsgPtr = (usbMsgPtr_t)report_buf[rq -> wIndex.bytes[0]];
+				else
+					usbMsgPtr = (usbMsgPtr_t)report_buf[0];
 				return REPORT_SIZE;
+			case USBRQ_HID_SET_REPORT:
+				if(rq -> wValue.bytes[1] == HID_REPORT_FEATURE) return configSetup(rq); // call "usbFunctionWrite" ("OUT" token)
+				break;
 			case USBRQ_HID_GET_IDLE:
 				if (rq -> wValue.bytes[0] > 0)
 				{
@@ -76,44 +159,86 @@ USB_PUBLIC uchar usbFunctionSetup(uchar data[8])
 					return 1;
 				}
 				break;
-			case USBRQ_HID_SET_IDLE: return USB_NO_MSG; // call "usbFunctionWrite" ("OUT" token)
-			/*
-			case USBRQ_HID_SET_IDLE:
-				// mb required reset "cnt_idle" and enable interrupt timer 0, cause 
+			case USBRQ_HID_SET_IDLE: // no data stage: "usbFunctionWrite" is only for feature report
+				// mb required reset "cnt_idle" and restart of IDLE slot, cause 
 				// "flag_idle" can be set during "delay_idle" change in large way
 				if(rq -> wValue.bytes[1] != 0) delay_idle = rq -> wValue.bytes[1];
-				else delay_idle = INIT_IDLE_TIME; // when the upper byte of "wValue" = 0, the duration is indefinite
-				*/
+				else delay_idle = cfg.delay_idle; // when the upper byte of "wValue" = 0, the duration is indefinite
+				break;
+		}
+	}
+	else if((rq -> bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_VENDOR) // see "vendor.h"
+	{
+		switch(rq -> bRequest)
+		{
+			case VENDOR_RQ_PS_ERRORS:
+				ps_err_read = ps_err;
+				if(rq -> wValue.bytes[0] == 1) memset(&ps_err, 0, sizeof(ps_err));
+				
+				usbMsgPtr = (usbMsgPtr_t)&ps_err_read;
+				return sizeof(ps_err_read);
+			
+			#ifdef PS_MEMCARD
+				case VENDOR_RQ_MC_READ:
+				case VENDOR_RQ_MC_WRITE:
+					return mcardSetup(rq); // call "usbFunctionRead" or "usbFunctionWrite"
+				case VENDOR_RQ_MC_STATUS:
+					usbMsgPtr = (usbMsgPtr_t)&mc_status;
+					return sizeof(mc_status);
+			#endif
+			
+			#ifdef HISTORY
+				case VENDOR_RQ_HISTORY:
+					return historySetup(rq); // call "usbFunctionRead"
+			#endif
+			
+			case VENDOR_RQ_POLL_NOW:
+				flag_poll_now = 1; // status stage goes at once, reports follow poll
+				break;
 		}
 	}
 	
 	return 0; // ignore data from host ("OUT" token)
 }
 
-USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len)
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len) // SET_FEATURE: config block, or sectors of memory card
 {
-	usbRequest_t *rq = (usbRequest_t*)data;
+	uchar res;
 	
-	if(rq -> wValue.bytes[1] != 0) delay_idle = rq -> wValue.bytes[1];
-	else delay_idle = INIT_IDLE_TIME; // when the upper byte of "wValue" = 0, the duration is indefinite
+	#ifdef PS_MEMCARD
+		if(mcardOwnsData()) return mcardWrite(data, len);
+	#endif
+	
+	res = configWrite(data, len);
 	
-	return 1;
+	if(res == 1) configApply(); // new config works at once, without re-enumeration
+	return res;
+}
+
+USB_PUBLIC uchar usbFunctionRead(uchar *data, uchar len) // GET_FEATURE: config block, sectors of memory card or history
+{
+	#ifdef PS_MEMCARD
+		if(mcardOwnsData()) return mcardRead(data, len);
+	#endif
+	
+	#ifdef HISTORY
+		if(historyOwnsData()) return historyRead(data, len);
+	#endif
+	
+	return configRead(data, len);
 }
 
 uchar initHW() // return chosen gamepad code: 0 - SEGA, 1 - PS
 {
 	DDR_LED |= (1 << LED0) | (1 << LED1);
-
+	
 	DDR_CTRL &= ~(1 << CTRL);
 	PORT_CTRL |= (1 << CTRL);
 
-// idle timer:
-	TCCR0A = (1 << WGM01); // CTC mode with OCRA
-	TCCR0B = (1 << CS02); // presc = 256 => 4 ms <=> 250 cnt
-	OCR0A = STEP_IDLE_CONF;
-	
-	TIMSK0 = (1 << OCIE0A);
-	
+// time base of cyclic executive (idle steps too, see "sched.h"), timers 0 and 2 are free:
+	TCCR1A = 0;
+	TCCR1B = TICK_T1_CS; // free-running, see "timing.h"
+
 // choose controller:
 	if((PIN_CTRL & (1 << CTRL)) == (1 << CTRL))
 		return 1; // PS
@@ -121,6 +246,24 @@ uchar initHW() // return chosen gamepad code: 0 - SEGA, 1 - PS
 		return 0; // SEGA
 }
 
+#if PS_ENGINE == PS_ENGINE_SPI
+
+void setSPISpeed(uchar div_log2) // SCK = F_CPU / 2^"div_log2", 1..7
+{
+	uchar spr;
+	
+	if(div_log2 < 1) div_log2 = 1;
+	if(div_log2 > 7) div_log2 = 7;
+	
+	if(div_log2 == 7) spr = 3; // F_CPU/128 is only without SPI2X
+	else spr = (div_log2 - 1) >> 1;
+	
+	SPCR = (SPCR & ~((1 << SPR0) | (1 << SPR1))) | spr;
+	
+	if((div_log2 & 0x01) & (div_log2 != 7)) SPSR |= (1 << SPI2X);
+	else SPSR &= ~(1 << SPI2X);
+}
+
 void initSPI()
 {
 // master SPI pins output:
@@ -130,49 +273,92 @@ void initSPI()
 // master SPI input:
 	DDR_PS &= ~(1 << PS_MISO);
 	PORT_PS |= (1 << PS_MISO);
+
+#ifdef SNES_PAD
+	DDR_PS |= (1 << SNES_LATCH2);
+	PORT_PS &= ~((1 << PS_CS) | (1 << SNES_LATCH2)); // latches are active high
+	PORT_PS &= ~(1 << PS_MISO); // pulled down outside (see "defines.h")
 	
+	SPCR |= (1 << SPE) | (1 << MSTR) | (1 << DORD) | (1 << CPOL); // 1st bit is out after latch: read on fall, pad shifts on front
+	setSPISpeed(SNES_SPI_DIV_LOG2);
+#else
 // SPI config:
 	SPCR |= (1 << SPE) | (1 << MSTR) | (1 << DORD); // enable SPI, master mode, LSB first mode
 	SPCR |= (1 << CPOL) | (1 << CPHA); // issue on fall, read on front
 	
-// set presc for SCK: F_CPU/128 (16 MHz / 128 = 125 kHz)
-	SPCR |= (1 << SPR0) | (1 << SPR1);
-	SPSR &= ~(1 << SPI2X);
+	setSPISpeed(SPI_DIV_LOG2);
+#endif
+}
+
+#else
+
+/*********************************************************************************/
+/* USART in master SPI mode (PS_ENGINE_USART): transmitter is double-buffered,   */
+/* so next command byte waits in UDR0 while current one shifts and frame goes    */
+/* without gaps between bytes; hardware SPI stays free                           */
+/*********************************************************************************/
+
+void setSPISpeed(uchar div_log2) // SCK = F_CPU / 2^"div_log2", 1..7: the same as for hardware SPI
+{
+	if(div_log2 < 1) div_log2 = 1;
+	if(div_log2 > 7) div_log2 = 7;
+	
+	UBRR0 = (1 << (div_log2 - 1)) - 1; // MSPIM: SCK = F_CPU / (2 * (UBRR0 + 1))
 }
 
-ISR(TIMER0_COMPA_vect)
+void initSPI() // call only when CTRL was read: XCK is on the same pin
 {
-	//TIMSK2 &= ~(1 << OCIE2A); // "cli" for avoid nested interrupts
-	sei();
+	DDR_PS |= (1 << PS_CS);
+	PORT_PS |= (1 << PS_CS);
 	
-	if(cnt_idle < delay_idle) cnt_idle++;
-	else
-	{
-		TIMSK0 &= ~(1 << OCIE0A);
-		flag_idle = 1;
-	}
-	//TIMSK2 |= (1 << OCIE2A); // "sei"
+	UBRR0 = 0; // must be zero while transmitter is enabled
+	DDRD |= (1 << PD4); // XCK output: master
+	UCSR0C = (1 << UMSEL01) | (1 << UMSEL00) | (1 << UDORD0) | (1 << UCPHA0) | (1 << UCPOL0); // MSPIM, LSB first, issue on fall, read on front
+	UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+	
+	setSPISpeed(SPI_DIV_LOG2);
+}
+
+#endif
+
+void configApply()
+{
+	delay_idle = cfg.delay_idle;
+	
+	#ifndef SNES_PAD // shift registers go at own speed
+		setSPISpeed(cfg.spi_div_log2);
+	#endif
+	
+	remapCompile(cfg.remap);
+	dpadCompile(cfg.dpad_mode);
+	HISTORY_DIRS(remap_lut[1][0x0F]); // PS directions: bits 4..7 of 1st byte before remap
 }
 
-uchar readSPI()
+#if PS_ENGINE == PS_ENGINE_SPI
+
+uchar readSPI() // return bytes in "ps_frame", 0 - failure
 {
 	uchar spsr_buf; // SPI status reg buf var
+	uchar len = PS_FRAME_LEN;
 	int froze_cnt; // for avoid froze when wait SPI transmit flag
 	
 	PORT_PS &= ~(1 << PS_CS); // set low CS before transfer
+	stampTake(&ps_stamp);
 	
-	for(uchar i = 0; i < 9; i++)
+	for(uchar i = 0; i < len; i++)
 	{
 		spsr_buf = SPDR; // read SPI data reg to clear all flags and prepare SPI transmit
-		
+	
 	// master SPI interface bytes:
 		if(i == 0)
 			SPDR = 0x01;
 		else if(i == 1)
 			SPDR = 0x42;
+		else if(i == 2)
+			SPDR = PS_CMD_TAP;
 		else
 			SPDR = 0xFF;
-			
+	
 	// wait end of SPI transfer:
 		froze_cnt = 0;
 		spsr_buf = SPSR & (1 << SPIF); // read SPI status reg
@@ -189,22 +375,467 @@ uchar readSPI()
 			
 			spsr_buf = SPSR & (1 << SPIF);
 		}
-		
+	
 	// get gamepad state:
-		if((i == 3) | (i == 4))
-			report_buf[i - 3] = ~SPDR; // buttons must be inverted
-		else if(i > 4)
-			report_buf[i - 3] = SPDR; // analogs
+		ps_frame[i] = SPDR;
+		
+		#ifdef PS_MULTITAP
+			if((i == 1) & (ps_frame[1] == PS_ID_MULTITAP)) len = PS_TAP_FRAME_LEN; // all slots in the same frame
+		#endif
 	}
 	
 	PORT_PS |= (1 << PS_CS); // set high CS
-	return 1; // successful: SPI packet complete
+	return len; // successful: SPI packet complete
+}
+
+uchar psExchange(uchar data) // one byte, CS is set by caller (memory card)
+{
+	int froze_cnt = 0;
+	
+	SPDR = data;
+	
+	while(!(SPSR & (1 << SPIF)))
+	{
+		if(++froze_cnt >= SPI_FROZE) return 0xFF; // as without device
+	}
+	
+	return SPDR;
+}
+
+#else
+
+uchar readSPI() // no more than 2 bytes are ahead of received: RX buffer can not overrun while USB interrupt
+{
+	uchar tx = 0, rx = 0;
+	uchar len = PS_FRAME_LEN;
+	int froze_cnt = 0;
+	
+	while(UCSR0A & (1 << RXC0)) ps_frame[0] = UDR0; // flush
+	
+	PORT_PS &= ~(1 << PS_CS);
+	stampTake(&ps_stamp);
+	
+	while(rx < len)
+	{
+		if((tx < len) & (tx - rx < 2) & ((UCSR0A & (1 << UDRE0)) != 0))
+		{
+			if(tx == 0) UDR0 = 0x01;
+			else if(tx == 1) UDR0 = 0x42;
+			else if(tx == 2) UDR0 = PS_CMD_TAP;
+			else UDR0 = 0xFF;
+			
+			tx++;
+		}
+		
+		if(UCSR0A & (1 << RXC0))
+		{
+			ps_frame[rx++] = UDR0;
+			froze_cnt = 0;
+			
+			#ifdef PS_MULTITAP
+				if((rx == 2) & (ps_frame[1] == PS_ID_MULTITAP)) len = PS_TAP_FRAME_LEN;
+			#endif
+		}
+		else if(++froze_cnt >= SPI_FROZE)
+		{
+			PORT_PS |= (1 << PS_CS);
+			return 0;
+		}
+	}
+	
+	PORT_PS |= (1 << PS_CS);
+	return len;
+}
+
+uchar psExchange(uchar data)
+{
+	int froze_cnt = 0;
+	
+	UDR0 = data;
+	
+	while(!(UCSR0A & (1 << RXC0)))
+	{
+		if(++froze_cnt >= SPI_FROZE) return 0xFF;
+	}
+	
+	return UDR0;
+}
+
+#endif
+
+static inline void errCount(uint16_t *cnt)
+{
+	if(*cnt != 0xFFFF) (*cnt)++;
+}
+
+uchar releasePlayers(uchar keep) // neutral report once for PS players not in "keep", return mask of them
+{
+	uchar gone = ps_players & ~keep;
+	
+	for(uchar i = 0; i < PLAYERS; i++)
+	{
+		if(gone & (1 << i))
+		{
+			buildNeutralReport(report_buf[i]);
+			stampReport(report_buf[i], report_seq, &ps_stamp);
+		}
+	}
+	
+	ps_players = keep;
+	return gone;
+}
+
+#ifdef PS_MULTITAP
+
+/*********************************************************************************/
+/* slot keeps its player while it is absent, so unplug or bad frame of one pad   */
+/* does not move others between players; new controller takes free player, or  */
+/* player of absent slot when all are taken                                      */
+/*********************************************************************************/
+
+uchar bindSlot(uchar slot) // return player, PS_SLOT_FREE - no endpoint for slot
+{
+	uchar used = 0, i, player;
+	
+	#ifdef PS_MOUSE
+		if(ps_bind[slot] == PS_SLOT_MOUSE) ps_mouse.btn = 0; // mouse is replaced by pad
+	#endif
+	
+	for(i = 0; i < PS_TAP_SLOTS; i++)
+	{
+		if(ps_bind[i] < PS_PAD_PLAYERS) used |= 1 << ps_bind[i];
+	}
+	
+	for(player = 0; player < PS_PAD_PLAYERS; player++)
+	{
+		if(!(used & (1 << player))) break;
+	}
+	
+	if(player >= PS_PAD_PLAYERS) // all players are bound: take one of absent slot
+	{
+		for(i = 0; i < PS_TAP_SLOTS; i++)
+		{
+			if((ps_bind[i] < PS_PAD_PLAYERS) & !ps_slot[i].present) break;
+		}
+		
+		if(i >= PS_TAP_SLOTS)
+		{
+			ps_bind[slot] = PS_SLOT_FREE;
+			return PS_SLOT_FREE;
+		}
+		
+		player = ps_bind[i];
+		ps_bind[i] = PS_SLOT_FREE;
+	}
+	
+	ps_bind[slot] = player;
+	dpadReset(player);
+	return player;
+}
+
+uchar pollTap() // return mask of players with new report
+{
+	uchar frame[PS_FRAME_LEN];
+	uchar res, player, keep = 0, rdy = 0;
+	
+	frame[0] = 0xFF;
+	
+	for(uchar slot = 0; slot < PS_TAP_SLOTS; slot++)
+	{
+		memcpy(&frame[1], &ps_frame[3 + (slot << 3)], PS_FRAME_LEN - 1); // slot as frame of single controller
+		
+		res = psCheckFrame(frame);
+		if(frame[1] == PS_ID_MULTITAP) res = PS_FRAME_BAD_ID;
+		
+		if(res >= PS_FRAME_BAD_ID) errCount(&ps_err.bad[res - PS_FRAME_BAD_ID]); // slot stays as is, report is held
+		else if(portUpdate(&ps_slot[slot], res == PS_FRAME_OK))
+		{
+			TRACE_EVENT(TRACE_ID_UNPLUG, slot);
+			
+			#ifdef PS_MOUSE
+				if(ps_bind[slot] == PS_SLOT_MOUSE)
+				{
+					ps_mouse.btn = 0; // buttons are released in next mouse report
+					ps_bind[slot] = PS_SLOT_FREE;
+				}
+			#endif
+		}
+		
+	#ifdef PS_MOUSE
+		if((res == PS_FRAME_OK) & (frame[1] == PS_ID_MOUSE))
+		{
+			ps_bind[slot] = PS_SLOT_MOUSE; // mouse does not take player
+			mouseAccumulate(&ps_mouse, frame);
+			continue;
+		}
+	#endif
+		
+		if(!ps_slot[slot].present) continue; // player of slot waits for it
+		
+		player = ps_bind[slot];
+		if(player >= PS_PAD_PLAYERS) player = bindSlot(slot); // new arrival
+		if(player >= PS_PAD_PLAYERS) continue; // no endpoint for it
+		
+		keep |= 1 << player;
+		
+		if(res == PS_FRAME_OK)
+		{
+			buildPSReport(report_buf[player], frame, player);
+			stampReport(report_buf[player], report_seq, &ps_stamp);
+			rdy |= 1 << player;
+		}
+	}
+	
+	return rdy | releasePlayers(keep);
+}
+#endif
+
+uchar pollPS() // return mask of players with new report, bit per player
+{
+	uint16_t now = TCNT1;
+	uchar res, present, len;
+	
+	if((int16_t)(now - ps_next_poll) < 0) return 0; // absent port: wait next probe
+	
+	do // bad frame is read again at once while PS_RETRY_US is not over
+	{
+		uint16_t xfer = TCNT1;
+		
+		len = readSPI();
+		if(!len)
+		{
+			res = PS_FRAME_ABSENT; // SPI is frozen
+			break;
+		}
+		
+		ps_err.xfer = TCNT1 - xfer;
+		
+		// raw answer, also bad or of absent controller:
+		STREAM_FRAME((len == PS_FRAME_LEN) ? STREAM_ID_PS : STREAM_ID_PS_TAP, ps_frame, len, ps_stamp.time);
+		errCount(&ps_err.frames);
+		
+		res = psCheckFrame(ps_frame);
+		if(res >= PS_FRAME_BAD_ID) errCount(&ps_err.bad[res - PS_FRAME_BAD_ID]);
+	}
+	while((res >= PS_FRAME_BAD_ID) & ((uint16_t)(TCNT1 - now) < US_TO_TICK(PS_RETRY_US)));
+	
+	if(res >= PS_FRAME_BAD_ID)
+	{
+		errCount(&ps_err.held);
+		TRACE_EVENT(TRACE_ID_BAD_FRAME, res);
+		
+		if(ps_bad_run < PS_HOLD_MAX)
+		{
+			ps_bad_run++;
+			ps_next_poll = now; // last good report stays, try again on next pass
+			return 0;
+		}
+		
+		res = PS_FRAME_ABSENT; // garbage for too long: connector is out
+	}
+	else ps_bad_run = 0;
+	
+	present = (res == PS_FRAME_OK);
+	report_seq++; // the same for all players of frame
+	
+	TRACE_EVENT(TRACE_ID_POLL, present);
+	
+	if(portUpdate(&ps_port, present))
+	{
+		TRACE_EVENT(TRACE_ID_UNPLUG, 0);
+		
+		#ifdef PS_MOUSE
+			ps_mouse.btn = 0; // buttons are released in next mouse report
+		#endif
+		
+		return releasePlayers(0); // show disconnection to host once
+	}
+	
+	if(present)
+	{
+		ps_next_poll = now; // full rate
+		
+		#ifdef PS_MULTITAP
+			if(ps_frame[1] == PS_ID_MULTITAP) return pollTap();
+		#endif
+		
+		#ifdef PS_MOUSE
+			if(ps_frame[1] == PS_ID_MOUSE)
+			{
+				mouseAccumulate(&ps_mouse, ps_frame);
+				return releasePlayers(0);
+			}
+		#endif
+		
+		buildPSReport(report_buf[0], ps_frame, 0); // PS port - 1st player
+		stampReport(report_buf[0], report_seq, &ps_stamp);
+		return releasePlayers(0x01) | 0x01;
+	}
+	
+	ps_next_poll = now + (US_TO_TICK(PS_PROBE_US) << ps_port.backoff);
+	return 0;
+}
+
+#ifdef SNES_PAD
+
+/*********************************************************************************/
+/* SNES / NES pad: LATCH high loads buttons in shift register, 1st bit is on     */
+/* DATA at once, then next bit on every rising edge of CLOCK; both bytes go by   */
+/* SPI without gaps, so pad is read in ~ 20 us instead of 16 bit-banged periods  */
+/*		 LATCH: __|~~|__________________________________________                 */
+/*		 CLOCK: ~~~~~~~~~|_|~|_|~|_|~ ... ~|_|~~~~~~~~~~~~~~~~~~~~               */
+/*		  DATA: -----.B.....Y.....SEL ... ...R..1..1..1..1.0.......              */
+/*********************************************************************************/
+
+void readSnes(uchar latch, uchar *data)
+{
+	PORT_PS |= (1 << latch);
+	_delay_us(SNES_LATCH_US);
+	PORT_PS &= ~(1 << latch);
+	
+	stampTake(&ps_stamp);
+	
+	for(uchar i = 0; i < SNES_DATA_LEN; i++) data[i] = psExchange(0xFF);
+}
+
+uchar pollSnes() // pads one after another on own latch lines, return mask of players with new report
+{
+	static const uchar latch[PLAYERS] = {PS_CS, SNES_LATCH2};
+	uchar present, rdy = 0;
+	
+	report_seq++;
+	
+	for(uchar i = 0; i < PLAYERS; i++)
+	{
+		readSnes(latch[i], snes_data[i]);
+		present = snesPresent(snes_data[i]);
+		
+		if(portUpdate(&snes_port[i], present))
+		{
+			TRACE_EVENT(TRACE_ID_UNPLUG, i);
+			buildNeutralReport(report_buf[i]); // show disconnection to host once
+		}
+		else if(present) buildSnesReport(report_buf[i], snes_data[i], i);
+		else continue;
+		
+		stampReport(report_buf[i], report_seq, &ps_stamp);
+		rdy |= 1 << i;
+	}
+	
+	return rdy;
+}
+
+#endif
+
+/*********************************************************************************/
+/* tasks of cyclic executive: no "usbPoll" inside, it goes between any two slots */
+/*********************************************************************************/
+
+void taskPoll() // controller poll and report build
+{
+	uchar rdy;
+	
+	if(!flag_ctrl) return;
+	
+	#ifdef PS_MEMCARD
+		if(mcardActive()) return; // the same bus: pads wait end of transfer
+	#endif
+	
+	#ifdef SNES_PAD
+		rdy = pollSnes();
+	#else
+		rdy = pollPS();
+	#endif
+	
+	flag_report_rdy[0] |= rdy & 0x01;
+	flag_report_rdy[1] |= rdy >> 1;
+	
+	for(uchar i = 0; i < PLAYERS; i++)
+	{
+		if(rdy & (1 << i)) HISTORY_SAMPLE(i, report_buf[i], ps_stamp.time);
+	}
+	
+	PORT_LED ^= (1 << LED0);
+}
+
+void taskIdle() // one step of USB idle time, was timer 0 interrupt
+{
+	if(cnt_idle < delay_idle) cnt_idle++;
+	else flag_idle = 1;
+}
+
+void taskHouse()
+{
+	configPoll(); // background EEPROM write
+}
+
+// slots: first due one in table order runs, see "sched.h"
+	#define SCHED_SLOTS(S) \
+		S(IDLE,		STEP_IDLE_US,	0,					SCHED_IDLE_WCET_US,		taskIdle) \
+		S(POLL,		SCHED_POLL_US,	0,					PS_POLL_WCET_US,		taskPoll) \
+		S(HOUSE,	SCHED_HOUSE_US,	SCHED_HOUSE_US / 2,	SCHED_HOUSE_WCET_US,	taskHouse)
+
+SCHED_DEFINE(SCHED_SLOTS)
+
+#if SCHED_TABLE_BAD(SCHED_SLOTS)
+	#error "SCHED_SLOTS: period does not fit timer 1 or phase is out of period"
+#endif
+
+// memory card: "usbFunctionRead/Write" do not wait for card (NAK or short packet, see "memcard.h"),
+// so card adds only SCHED_MC_WCET_US of "mcardPoll" to pass
+#if SCHED_WCET_SUM(SCHED_SLOTS) + SCHED_USB_WCET_US + SCHED_MC_WCET_US > SCHED_USB_GAP_US
+	#error "SCHED_SLOTS: worst cases of slots do not fit SCHED_USB_GAP_US between usbPoll calls"
+#endif
+
+void pollNow() // VENDOR_RQ_POLL_NOW: poll out of slot table, reports of all players go without idle wait
+{
+	flag_poll_now = 0;
+	ps_next_poll = TCNT1; // absent port is probed too
+	
+	taskPoll();
+	schedRestart(SCHED_POLL); // next regular poll in full period after this one
+	
+	for(uchar i = 0; i < PS_PAD_PLAYERS; i++) flag_report_rdy[i] = 1; // answer also without change
+	flag_idle = 1;
+}
+
+void sendReports() // send report immediately after "idle" time has passed, players go independently on own endpoints
+{
+	uchar sent = 0;
+	
+	if(flag_report_rdy[0] && usbInterruptIsReady())
+	{
+		usbSetInterrupt(HISTORY_SEND(0, report_buf[0]), REPORT_SIZE);  // ~ 31.5 us, with sticky presses
+		
+		TRACE_EVENT(TRACE_ID_REPORT, 0);
+		flag_report_rdy[0] = 0;
+		sent = 1;
+	}
+	
+#ifndef PS_MOUSE
+	if(flag_report_rdy[1] && usbInterruptIsReady3())
+	{
+		usbSetInterrupt3(HISTORY_SEND(1, report_buf[1]), REPORT_SIZE);
+		
+		TRACE_EVENT(TRACE_ID_REPORT, 1);
+		flag_report_rdy[1] = 0;
+		sent = 1;
+	}
+#endif
+	
+	if(sent & !(flag_report_rdy[0] | flag_report_rdy[1])) // endpoint was busy: its report goes on next pass
+	{
+		cnt_idle = 0;
+		flag_idle = 0;
+		schedRestart(SCHED_IDLE); // idle steps go from now
+		
+		PORT_LED ^= (1 << LED1);
+	}
 }
 
 int main()
 {
-	uchar flag_report_rdy = 0;
-	uchar flag_ctrl = 0;
+	uchar poll_now;
 	
 	flag_ctrl = initHW();
 	
@@ -213,57 +844,41 @@ int main()
 	//else
 		//initSEGA();
 	
-	#ifndef DEBUG
-		usbDeviceConnect();
-		usbInit();
-	#endif
+	configLoad();
+	configApply();
+	
+	for(uchar i = 0; i < PLAYERS; i++) buildNeutralReport(report_buf[i]);
 	
+	usbDeviceConnect();
+	usbInit();
+
 // full reset timer:
-	TCNT0 = 0;
-	TCNT2 = 0;
+	TCNT1 = 0;
+	schedInit();
 	
-	TIFR0 |= (1 << OCF0A);
-	TIFR2 |= (1 << OCF2A);
+	#ifdef TRACE_USART
+		traceInit();
+	#endif
 	
 	sei();
     while(1) 
     {
-		#ifndef DEBUG
-			usbPoll(); // ~ 9.63 us (all timings write in 16 MHz CPU freq)
+		usbPoll(); // ~ 9.63 us (all timings write in 16 MHz CPU freq)
+		
+		poll_now = flag_poll_now;
+		if(poll_now) pollNow(); // instead of slot in this pass: time between "usbPoll" calls stays bounded
+		
+		if(flag_idle) sendReports();
+		
+		#ifdef PS_MOUSE // no idle rate: sum goes as soon as host has taken previous one
+			if(usbInterruptIsReady3() && mouseDrain(&ps_mouse, mouse_report))
+				usbSetInterrupt3(mouse_report, MOUSE_REPORT_SIZE);
 		#endif
 		
-		if(flag_idle & flag_report_rdy) // send report immediately after "idle" time has passed:
-		{
-			if(usbInterruptIsReady())
-			{
-				#ifndef DEBUG
-					usbSetInterrupt(report_buf, REPORT_SIZE);  // ~ 31.5 us
-				#endif
-				
-				cnt_idle = 0;
-				
-				flag_idle = 0;
-				flag_report_rdy = 0;
-				
-			// full reset timer 0 then enable interrupt:
-				TCNT0 = 0;
-				TIFR0 |= (1 << OCF0A);
-				TIMSK0 |= (1 << OCIE0A);
-				
-				PORT_LED ^= (1 << LED1);
-			}
-		}
+		#ifdef PS_MEMCARD
+			if(flag_ctrl & mcardActive()) mcardPoll(); // byte of sector per pass, not slot period: transfer goes at full rate
+		#endif
 		
-		if(flag_ctrl) // build report:
-		{
-			flag_report_rdy = readSPI();
-			
-			PORT_LED ^= (1 << LED0);
-		}
-		//else
-		//{
-		//	
-		//	PORT_LED ^= (1 << LED0);
-		//}
+		if(!poll_now) schedRun(); // one due slot
     }
 }
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "memcard.h"
+
+#ifdef PS_MEMCARD
+
+#include <avr/io.h>
+#include <util/delay.h>
+#include <string.h>
+
+#include "vendor.h"
+
+mc_status_t mc_status;
+
+static uchar mc_buf[2][MC_SECTOR];
+static uchar mc_full[2]; // read: sector is taken from card, write: sector is taken from host
+
+static uchar mc_cmd = 0; // MC_CMD_READ or MC_CMD_WRITE of last transfer
+static uchar mc_usb_on = 0; // data stage of current control transfer is for card
+static uchar mc_busy = 0; // transfer goes (read ahead, last sectors of write too): pads are not polled
+static uint16_t mc_last; // timer 1 cnt of last call from USB side
+
+// USB side:
+	static uchar mc_usb_buf = 0;
+	static uchar mc_usb_pos = 0;
+	static uint16_t mc_usb_sector; // next sector to host
+	static uint16_t mc_usb_left = 0; // sectors
+
+// card side:
+	static uchar mc_card_buf = 0;
+	static uint16_t mc_card_sector;
+	static uint16_t mc_card_left = 0;
+	static uchar mc_spi_on = 0; // transaction of "mc_status.sector" goes with CS low
+	static uchar mc_spi_pos;
+	static uchar mc_chk;
+	static uchar mc_tries;
+
+static void cardEnd(uchar result)
+{
+	if(mc_spi_on) PORT_PS |= (1 << PS_CS);
+	
+	mc_spi_on = 0;
+	mc_busy = 0;
+	if(mc_status.result == MC_BUSY) mc_status.result = result;
+	
+	if(usbAllRequestsAreDisabled()) usbEnableAllRequests(); // next packet of write gets stall
+}
+
+static void cardStep() // one byte of sector transaction: ~ 80 us at 125 kHz
+{
+	uchar *buf = mc_buf[mc_card_buf];
+	uchar i = mc_spi_pos;
+	uchar msb = mc_status.sector >> 8;
+	uchar lsb = mc_status.sector;
+	uchar out = 0x00, in, err = MC_OK;
+	uchar len = (mc_cmd == MC_CMD_READ) ? MC_READ_LEN : MC_WRITE_LEN;
+	
+	if(i == 0)
+	{
+		PORT_PS &= ~(1 << PS_CS);
+		mc_chk = msb ^ lsb;
+	}
+	else _delay_us(MC_GAP_US); // card answers ACK after every byte, its line is not read
+
+// byte to card:
+	if(i == 0) out = MC_ADDR;
+	else if(i == 1) out = mc_cmd;
+	else if(i == 4) out = msb;
+	else if(i == 5) out = lsb;
+	else if(mc_cmd == MC_CMD_WRITE)
+	{
+		if(i < 6 + MC_SECTOR)
+		{
+			out = buf[i - 6];
+			mc_chk ^= out;
+		}
+		else if(i == 6 + MC_SECTOR) out = mc_chk;
+	}
+	
+	in = psExchange(out);
+
+// byte from card:
+	if((i == 2) & (in != 0x5A)) err = MC_ERR_NO_CARD;
+	else if((i == 3) & (in != 0x5D)) err = MC_ERR_NO_CARD;
+	else if(mc_cmd == MC_CMD_READ)
+	{
+		if(((i == 6) & (in != 0x5C)) | ((i == 7) & (in != 0x5D))) err = MC_ERR_NO_CARD;
+		else if(((i == 8) & (in != msb)) | ((i == 9) & (in != lsb))) err = MC_ERR_SECTOR; // card confirms sector
+		else if((i >= 10) & (i < 10 + MC_SECTOR))
+		{
+			buf[i - 10] = in;
+			mc_chk ^= in;
+		}
+		else if((i == 10 + MC_SECTOR) & (in != mc_chk)) err = MC_ERR_CHECKSUM;
+	}
+	else if(((i == 7 + MC_SECTOR) & (in != 0x5C)) | ((i == 8 + MC_SECTOR) & (in != 0x5D))) err = MC_ERR_NO_CARD;
+	
+	if((err == MC_OK) & (++i < len))
+	{
+		mc_spi_pos = i;
+		return;
+	}
+
+// end of transaction:
+	PORT_PS |= (1 << PS_CS);
+	mc_spi_on = 0;
+	
+	if(err == MC_OK)
+	{
+		mc_status.end = in;
+		
+		if(in == 0x4E) err = MC_ERR_CHECKSUM; // write: card got bad checksum
+		else if(in != MC_END_GOOD) err = MC_ERR_SECTOR;
+	}
+	
+	if((err == MC_ERR_CHECKSUM) & (++mc_tries < MC_RETRIES))
+	{
+		mc_spi_pos = 0;
+		mc_spi_on = 1; // the same sector again
+		return;
+	}
+	
+	if(err != MC_OK)
+	{
+		cardEnd(err);
+		return;
+	}
+	
+	mc_full[mc_card_buf] = (mc_cmd == MC_CMD_READ);
+	mc_card_buf ^= 1;
+	
+	if((mc_cmd == MC_CMD_WRITE) & (mc_card_left == 0)) cardEnd(MC_OK); // last sector is on card: MC_BUSY is over
+}
+
+static void cardNext() // start next sector when its buffer is ready
+{
+	if(mc_spi_on | (mc_card_left == 0) | (mc_status.result != MC_BUSY)) return;
+	if(mc_full[mc_card_buf] != (mc_cmd == MC_CMD_WRITE)) return; // read: USB still takes it, write: not taken from host yet
+	
+	mc_status.sector = mc_card_sector++;
+	mc_card_left--;
+	
+	mc_tries = 0;
+	mc_spi_pos = 0;
+	mc_spi_on = 1;
+}
+
+usbMsgLen_t mcardSetup(usbRequest_t *rq)
+{
+	uint16_t sector = rq -> wValue.word;
+	uint16_t count = rq -> wLength.word / MC_SECTOR;
+	uint16_t ahead;
+	uchar cmd = (rq -> bRequest == VENDOR_RQ_MC_READ) ? MC_CMD_READ : MC_CMD_WRITE;
+	uchar bad = (count == 0) | (rq -> wLength.word % MC_SECTOR != 0) | (sector >= MC_SECTORS) | (count > MC_SECTORS - sector);
+	
+	mcardCancel();
+	
+	mc_usb_on = 1;
+	mc_last = TCNT1;
+	
+	if(mc_busy & (mc_cmd == MC_CMD_READ) & (cmd == MC_CMD_READ) & (sector == mc_usb_sector) & !bad) // host asks again after short packet
+	{
+		ahead = mc_card_sector - sector; // taken from card or going, not given to host yet
+		
+		mc_usb_left = count;
+		mc_card_left = (count > ahead) ? count - ahead : 0;
+		return USB_NO_MSG; // sectors read ahead go at once
+	}
+	
+	if(mc_busy) cardEnd(MC_ERR_CANCEL); // other transfer: previous one is cut
+	
+	mc_cmd = cmd;
+	mc_busy = 1;
+	
+	mc_status.result = MC_BUSY;
+	mc_status.end = 0;
+	mc_status.sector = sector;
+	
+	mc_full[0] = 0;
+	mc_full[1] = 0;
+	mc_usb_buf = 0;
+	mc_usb_pos = 0;
+	mc_card_buf = 0;
+	
+	mc_card_sector = sector;
+	mc_card_left = count;
+	mc_usb_sector = sector;
+	mc_usb_left = count;
+	
+	if(bad)
+	{
+		cardEnd(MC_ERR_SECTOR);
+		if(mc_cmd == MC_CMD_READ) return 0; // no data, write is stalled in "mcardWrite"
+	}
+	
+	cardNext(); // read: 1st sector goes at once
+	return USB_NO_MSG; // call "usbFunctionRead" or "usbFunctionWrite"
+}
+
+void mcardCancel()
+{
+	if(mc_usb_on & mc_busy) cardEnd(MC_ERR_CANCEL); // host has cut data stage
+	mc_usb_on = 0;
+}
+
+uchar mcardOwnsData()
+{
+	return mc_usb_on;
+}
+
+uchar mcardActive()
+{
+	return mc_busy;
+}
+
+void mcardPoll()
+{
+	if(!mc_busy) return;
+	
+	if(mc_spi_on) cardStep();
+	else
+	{
+		cardNext();
+		if(!mc_spi_on & ((uint16_t)(TCNT1 - mc_last) > US_TO_TICK(MC_TIMEOUT_US))) cardEnd(MC_ERR_CANCEL); // host is gone
+	}
+	
+	if(usbAllRequestsAreDisabled() & !mc_full[mc_usb_buf]) usbEnableAllRequests(); // write: buffer is free, next packets from host
+}
+
+uchar mcardRead(uchar *data, uchar len) // no wait: bounded by memcpy of packet
+{
+	uchar b = mc_usb_buf;
+	
+	mc_last = TCNT1;
+	
+	if(!mc_full[b]) // card is slower (or error in "mc_status"): short packet ends transfer, card reads ahead from main loop
+	{
+		mc_usb_on = 0;
+		return 0;
+	}
+	
+	memcpy(data, &mc_buf[b][mc_usb_pos], len); // "wLength" is multiple of MC_SECTOR: packets do not cross sectors
+	mc_usb_pos += len;
+	
+	if(mc_usb_pos >= MC_SECTOR)
+	{
+		mc_usb_pos = 0;
+		mc_full[b] = 0;
+		mc_usb_buf ^= 1;
+		mc_usb_sector++;
+		
+		if(--mc_usb_left == 0)
+		{
+			mc_usb_on = 0;
+			cardEnd(MC_OK); // sector read ahead for longer request is cut
+		}
+		else cardNext();
+	}
+	
+	return len;
+}
+
+uchar mcardWrite(uchar *data, uchar len) // no wait: host gets NAK while both buffers are on card
+{
+	uchar b = mc_usb_buf;
+	
+	mc_last = TCNT1;
+	
+	if(!mc_busy) return 0xFF; // stall, error is in "mc_status"
+	
+	memcpy(&mc_buf[b][mc_usb_pos], data, len);
+	mc_usb_pos += len;
+	
+	if(mc_usb_pos < MC_SECTOR) return 0;
+	
+	mc_usb_pos = 0;
+	mc_full[b] = 1;
+	mc_usb_buf ^= 1;
+	cardNext();
+	
+	if(--mc_usb_left == 0) // status stage at once, last sectors go to card from main loop
+	{
+		mc_usb_on = 0;
+		return 1;
+	}
+	
+	if(mc_full[mc_usb_buf]) usbDisableAllRequests(); // card is slower: NAK until "mcardPoll" frees next buffer
+	return 0;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef MEMCARD_H_
+#define MEMCARD_H_
+
+#include "defines.h"
+
+#include <stdint.h>
+
+#include "usbdrv/usbdrv.h"
+
+/*********************************************************************************/
+/* PS memory card on PS port (PS_MEMCARD): sectors go through vendor requests    */
+/* VENDOR_RQ_MC_READ / VENDOR_RQ_MC_WRITE as long control transfers,            */
+/* "wValue" - first sector, "wLength" - 128 * sectors (up to 511 in request)    */
+/*                                                                               */
+/* two sector buffers: while USB takes one (8 bytes per packet), the next sector */
+/* goes on SPI byte by byte from main loop ("mcardPoll"), so card and USB work   */
+/* at the same time; "usbFunctionRead/Write" never wait for card:                */
+/*		write - both buffers are on card: host gets NAK (V-USB flow control)     */
+/*			until "mcardPoll" frees one; status stage goes after last packet,    */
+/*			last sectors go to card later: host waits end of MC_BUSY in status   */
+/*		read - next sector is not taken yet: short packet ends transfer, card    */
+/*			reads ahead, host asks again from next sector (1st try of each       */
+/*			request is short: card starts at SETUP)                              */
+/* throughput is the slower side: card ~ 11 KB/s (140 bytes of ~ 80 us per       */
+/* sector), USB - 8 bytes per low speed packet, extra request per short read     */
+/* pads are not polled while transfer goes, SETUP inside data stage cancels it   */
+/*********************************************************************************/
+
+#define MC_SECTOR	128
+#define MC_SECTORS	1024
+#define MC_RETRIES	3 /* tries of sector with bad checksum */
+
+#define MC_GAP_US		10		/* between bytes: card gives ACK after each byte */
+#define MC_TIMEOUT_US	100000	/* no calls from USB side: host is gone, pads are polled again */
+
+// card command:
+	#define MC_ADDR			0x81
+	#define MC_CMD_READ		0x52 /* 'R' */
+	#define MC_CMD_WRITE	0x57 /* 'W' */
+	#define MC_END_GOOD		0x47 /* 'G' */
+	#define MC_END_BAD_SECTOR	0xFF
+
+#define MC_READ_LEN		(10 + MC_SECTOR + 2)	/* bytes of read transaction with CS low */
+#define MC_WRITE_LEN	(6 + MC_SECTOR + 4)		/* bytes of write transaction */
+
+// result (VENDOR_RQ_MC_STATUS):
+	#define MC_OK				0
+	#define MC_ERR_NO_CARD		1	/* no 0x5A 0x5D / 0x5C 0x5D answer */
+	#define MC_ERR_CHECKSUM		2	/* MC_RETRIES times */
+	#define MC_ERR_SECTOR		3	/* sector is out of card or card says so */
+	#define MC_ERR_CANCEL		4	/* host has cut transfer */
+	#define MC_BUSY				5	/* transfer goes: read ahead or last sectors of write */
+
+typedef struct
+{
+	uchar result;	// MC_OK, MC_ERR_*, MC_BUSY
+	uchar end;		// last byte of last transaction: MC_END_GOOD, 0x4E - card got bad checksum, MC_END_BAD_SECTOR
+	uint16_t sector; // last sector on card
+} mc_status_t;
+
+extern mc_status_t mc_status;
+
+uchar psExchange(uchar data); // one byte on PS bus, CS is set by caller ("main.c", both PS_ENGINE)
+
+usbMsgLen_t mcardSetup(usbRequest_t *rq); // VENDOR_RQ_MC_READ / WRITE
+void mcardCancel(); // any SETUP: previous control transfer is over
+uchar mcardOwnsData(); // "usbFunctionRead/Write" are for card
+uchar mcardActive(); // transfer goes: pads are not polled
+void mcardPoll(); // main loop instead of pad poll while "mcardActive"
+
+uchar mcardRead(uchar *data, uchar len); // 0 - sector is not taken from card yet: short packet
+uchar mcardWrite(uchar *data, uchar len); // 1 - last sector is taken (card goes on: MC_BUSY), 0xFF - error: stall
+
+#endif /* MEMCARD_H_ */
@@ -0,0 +1,34 @@
+#ifndef PRESENCE_H_
+#define PRESENCE_H_
+
+#include "defines.h"
+
+#ifndef uchar
+	#define uchar unsigned char
+#endif
+
+/*********************************************************************************/
+/* per port presence: present port is polled at full rate, absent port is probed */
+/* with period "base << backoff", "backoff" grows by one on every failed probe   */
+/* up to PROBE_BACKOFF_MAX, so hotplug is found in 2^PROBE_BACKOFF_MAX base      */
+/* periods at worst                                                              */
+/*********************************************************************************/
+
+typedef struct
+{
+	uchar present;
+	uchar backoff;
+} port_state_t;
+
+static inline uchar portUpdate(port_state_t *port, uchar present) // return 1 when port was unplugged right now
+{
+	uchar lost = port -> present & !present;
+
+	if(present) port -> backoff = 0;
+	else if(port -> backoff < PROBE_BACKOFF_MAX) port -> backoff++;
+
+	port -> present = present;
+	return lost;
+}
+
+#endif /* PRESENCE_H_ */
@@ -5,17 +5,35 @@
 #include <util/delay.h>
 
 #include "usbdrv/usbdrv.h"
+#include "remap.h"
+#include "config.h"
+#include "sched.h"
 #include "descriptor.h"
 
 #ifdef DEBUG
 	#warning "DEBUG is enabled"
 #endif
 
+#ifdef REPORT_STAMP
+	#error "REPORT_STAMP is not supported: report here has no stamp field, use main.c"
+#endif
+
+#if defined(PS_MOUSE) || defined(SNES_PAD)
+	#error "PS_MOUSE and SNES_PAD are not supported: use main.c"
+#endif
+
+#ifdef DPAD_HAT
+	#error "DPAD_HAT is not supported: report here has no SOCD cleaning and hat field, use main.c"
+#endif
+
 #ifdef PROTEUS
 	#warning "PROTEUS SIM is enabled"
 #endif
 
-uchar report_buf[REPORT_SIZE] = {0x7F, 0x7F, 0x7F, 0x7F, 0x00, 0x00};
+uchar report_buf[PLAYERS][REPORT_SIZE] = { // one player on PS port: 2nd interface stays neutral
+	{0x7F, 0x7F, 0x7F, 0x7F, 0x00, 0x00},
+	{0x00, 0x00, REPORT_AXIS_NEUTRAL, REPORT_AXIS_NEUTRAL, REPORT_AXIS_NEUTRAL, REPORT_AXIS_NEUTRAL}
+};
 
 uchar delay_idle = INIT_IDLE_TIME; // step - 4ms
 uchar cnt_idle = 0;
@@ -46,7 +64,7 @@ uchar flag_report = 0; // shows that information from gamepad is ready to form l
 /*		  ACK:									    |__|						 */
 /*********************************************************************************/
 
-USB_PUBLIC uchar usbFunctionDescriptor(usbRequest_t * rq)
+USB_PUBLIC usbMsgLen_t usbFunctionDescriptor(usbRequest_t * rq)
 {
 	if (rq->bRequest == USBRQ_GET_DESCRIPTOR)
 	{
@@ -70,7 +88,7 @@ USB_PUBLIC uchar usbFunctionDescriptor(usbRequest_t * rq)
 	return 0x00;
 }
 
-USB_PUBLIC uchar usbFunctionSetup(uchar data[8])
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8])
 {
 	usbRequest_t *rq = (usbRequest_t*)data;
 	
@@ -79,8 +97,16 @@ USB_PUBLIC uchar usbFunctionSetup(uchar data[8])
 		switch (rq -> bRequest)
 		{
 			case USBRQ_HID_GET_REPORT:
-				usbMsgPtr = (usbMsgPtr_t)report_buf;
+				if(rq -> wValue.bytes[1] == HID_REPORT_FEATURE) return configSetup(rq); // call "usbFunctionRead"
+				
+				if(rq -> wIndex.bytes[0] < PLAYERS) // interface number <=> player
+					usbMsgPtr = (usbMsgPtr_t)report_buf[rq -> wIndex.bytes[0]];
+				else
+					usbMsgPtr = (usbMsgPtr_t)report_buf[0];
 				return REPORT_SIZE;
+			case USBRQ_HID_SET_REPORT:
+				if(rq -> wValue.bytes[1] == HID_REPORT_FEATURE) return configSetup(rq); // call "usbFunctionWrite" ("OUT" token)
+				break;
 			case USBRQ_HID_GET_IDLE:
 				if (rq -> wValue.bytes[0] > 0)
 				{
@@ -88,37 +114,44 @@ USB_PUBLIC uchar usbFunctionSetup(uchar data[8])
 					return 1;
 				}
 				break;
-			case USBRQ_HID_SET_IDLE: return USB_NO_MSG; // call "usbFunctionWrite" ("OUT" token)
-			/*
-			case USBRQ_HID_SET_IDLE:
-				// mb required reset "cnt_idle" and enable interrupt timer 0, cause 
+			case USBRQ_HID_SET_IDLE: // no data stage: "usbFunctionWrite" is only for feature report
+				// mb required reset "cnt_idle" and restart of IDLE slot, cause 
 				// "flag_idle" can be set during "delay_idle" change in large way
 				if(rq -> wValue.bytes[1] != 0) delay_idle = rq -> wValue.bytes[1];
-				else delay_idle = INIT_IDLE_TIME; // when the upper byte of "wValue" = 0, the duration is indefinite
-				*/
+				else delay_idle = cfg.delay_idle; // when the upper byte of "wValue" = 0, the duration is indefinite
+				break;
 		}
 	}
 	
 	return 0; // ignore data from host ("OUT" token)
 }
 
-USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len)
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len) // SET_FEATURE: config block
 {
-	usbRequest_t *rq = (usbRequest_t*)data;
-	
-	if(rq -> wValue.bytes[1] != 0) delay_idle = rq -> wValue.bytes[1];
-	else delay_idle = INIT_IDLE_TIME; // when the upper byte of "wValue" = 0, the duration is indefinite
+	uchar res = configWrite(data, len);
 	
-	return 1;
+	if(res == 1) configApply(); // new config works at once, without re-enumeration
+	return res;
+}
+
+USB_PUBLIC uchar usbFunctionRead(uchar *data, uchar len) // GET_FEATURE: config block
+{
+	return configRead(data, len);
+}
+
+void configApply()
+{
+	delay_idle = cfg.delay_idle;
+	remapCompile(cfg.remap);
 }
 
 inline void hardwareInit()
 {
 	DDR_LED = (1 << LED0) | (1 << LED1);
 
-	// for idle time:
-	TCCR1B = (1 << CS10);
-	TIMSK1 = (1 << TOIE1);
+	// timers (0 and 2 are free: CLK edges and idle steps go in cyclic executive, see "sched.h"):
+	TCCR1A = 0;
+	TCCR1B = TICK_T1_CS; // free-running, see "timing.h"
 	
 // this func call after "hardware_SEGA_init" when PS mode is activating
 	DDR_PS &= ~(1 << PS_MISO) & ~(1 << PS_ACK); // inputs
@@ -133,52 +166,21 @@ inline void hardwareInit()
 // on MISO PULLUP external and must be turn off on mc
 	PORT_PS &= ~(1 << PS_ACK) & ~(1 << PS_MISO); // no pullup
 	PORT_PS = (1 << PS_CS) | (1 << PS_CLK);
-	
-// duplicate main timer:
-	TCCR0A = (1 << WGM01);
-	TCCR0B = (1 << CS01); // presc = 8 => 70 us <=> 140 cnt
-	TIMSK0 = (1 << OCIE0A);
-	OCR0A = CLK_HALF_PER + DELTA;
-	
-// for PS CLK ~ 7 kHz, DO NOT forget to approve with CPU freq:
-	TCCR2A = (1 << WGM21); // CTC mode with OCR2A 
-	TCCR2B = (1 << CS21); // presc = 8 => half period CLK 70 us <=> 140 cnt
-	OCR2A = CLK_HALF_PER;
-	TIMSK2 = (1 << OCIE2A);
 }
 
-ISR(TIMER1_OVF_vect)
-{
-	TIMSK0 &= ~(1 << OCIE0A);
-	TIMSK2 &= ~(1 << OCIE2A);
-	
-		sei();
-		
-		if(cnt_idle < delay_idle) cnt_idle++;
-		else
-		{
-			TIMSK1 &= ~(1 << TOIE1);
-			flag_idle = 1;
-		}
-	
-	TIMSK0 |= (1 << OCIE0A);
-	TIMSK2 |= (1 << OCIE2A);
-}
+/*********************************************************************************/
+/* tasks of cyclic executive: no "usbPoll" inside, it goes between any two slots */
+/* CLK edge was timer 2 interrupt (with timer 0 as its watchdog): now late edge  */
+/* only stretches CLK, pad is clocked by adapter, so frame is not broken         */
+/*********************************************************************************/
 
 #define END_ONE_BYTE (cnt_edge == 18)
 #define ACT_TRANS (cnt_edge < 16)
 #define IDLE_STATE (cnt_edge == 15)
 #define LAST_BYTE (cnt_byte == 9)
 
-ISR(TIMER2_COMPA_vect)
-{	
-	TCNT0 = 5; // reset duplicate timer
-	TIMSK0 &= ~(1 << OCIE0A); // "cli"
-	
-	sei();
-	
-	if((TIFR0 & (1 << OCF0A)) == (1 << OCF0A)) clearShiftBuf();
-	
+void taskEdge() // one half period of CLK
+{
 	// CLK:
 	if((cnt_byte > 0) & ACT_TRANS) PORT_PS ^= (1 << PS_CLK);
 	
@@ -198,7 +200,7 @@ ISR(TIMER2_COMPA_vect)
 	if((cnt_byte == 0) & IDLE_STATE) PORT_PS &= ~(1 << PS_CS);
 	else if(LAST_BYTE & END_ONE_BYTE) PORT_PS |= (1 << PS_CS);
 	
-	// counters - required go to ASM:
+	// counters:
 	if(cnt_byte == 0) // between byte transmit
 	{
 		if(IDLE_STATE)
@@ -228,91 +230,92 @@ ISR(TIMER2_COMPA_vect)
 			{
 				flag_report = 1;
 				cnt_byte = 0;
-				
-				//TIMSK1 &= ~(1 << OCIE1A);
 			}
 			else cnt_byte++;
 		}
 		else cnt_edge++;
 	}
-	
-	TIMSK0 |= (1 << OCIE0A); // "sei"
 }
 
-inline void clearShiftBuf()
+void taskIdle() // one step of USB idle time, was timer 1 interrupt
 {
-	if(!flag_report)
-	{
-		shift_report_buf[0] = 0;
-		shift_report_buf[1] = 0;
-		shift_report_buf[2] = 0;
-		shift_report_buf[3] = 0;
-		shift_report_buf[4] = 0;
-		shift_report_buf[5] = 0;	
-	}
-	
-	cnt_rep_buf = 5;
-	
-	cnt_edge = 0;
-	cnt_byte = 0;
-	
-	PORT_PS |= (1 << PS_CS) | (1 << PS_CLK);
-	TIFR0 |= (1 << OCF0A);
+	if(cnt_idle < delay_idle) cnt_idle++;
+	else flag_idle = 1;
+}
+
+void taskHouse()
+{
+	configPoll(); // background EEPROM write
 }
 
+// slots: first due one in table order runs, see "sched.h"
+	#define SCHED_SLOTS(S) \
+		S(EDGE,		CLK_HALF_PER_US,	0,					SCHED_EDGE_WCET_US,		taskEdge) \
+		S(IDLE,		STEP_IDLE_US,		0,					SCHED_IDLE_WCET_US,		taskIdle) \
+		S(HOUSE,	SCHED_HOUSE_US,		SCHED_HOUSE_US / 2,	SCHED_HOUSE_WCET_US,	taskHouse)
+
+SCHED_DEFINE(SCHED_SLOTS)
+
+#if SCHED_TABLE_BAD(SCHED_SLOTS)
+	#error "SCHED_SLOTS: period does not fit timer 1 or phase is out of period"
+#endif
+
+#if SCHED_WCET_SUM(SCHED_SLOTS) + SCHED_USB_WCET_US > SCHED_USB_GAP_US
+	#error "SCHED_SLOTS: worst cases of slots do not fit SCHED_USB_GAP_US between usbPoll calls"
+#endif
+
 void main()
 {
 	char flag_report_rdy = 0;
 	
 	hardwareInit();
 	
+	configLoad();
+	configApply();
+	
 	#ifndef DEBUG
 		usbDeviceConnect();
 		usbInit();
 	#endif
 	
-// full reset timers:
-	TCNT0 = 0;
 	TCNT1 = 0;
-	TCNT2 = 0;
-	
-	TIFR0 |= (1 << OCF0A);
-	TIFR1 |= (1 << TOV1);
-	TIFR2 |= (1 << OCF2A);
+	schedInit();
 	
 	sei();
     while (1) 
     {
+		usbPoll(); // every pass, was only between frames: slots are bounded by SCHED_SLOTS check
+		
 		if(flag_idle & flag_report_rdy) // send report immediately after "idle" time has passed:
 		{
 			if(usbInterruptIsReady())
 			{
 				#ifndef DEBUG
-					usbSetInterrupt(report_buf, REPORT_SIZE);  // ~ 31.5 us
+					usbSetInterrupt(report_buf[0], REPORT_SIZE);  // ~ 31.5 us
 				#endif
 				
 				#ifdef PROTEUS
-					usbSetInterrupt(report_buf, REPORT_SIZE);
+					usbSetInterrupt(report_buf[0], REPORT_SIZE);
 				#endif
 				
-				//clearShiftBuf();
 				flag_report_rdy = 0;
 				
-			// full reset idle timer then enable interrupt:
-				TCNT1 = 0;
-				TIFR1 |= (1 << TOV1); 
-				TIMSK1 |= (1 << TOIE1);
+				cnt_idle = 0;
+				flag_idle = 0;
+				schedRestart(SCHED_IDLE); // idle steps go from now
 			}
 		}
 		
 		if(flag_report) // build report:
 		{
-			report_buf[0] = shift_report_buf[1]; // mb required "turn over" descriptor
-			report_buf[1] = shift_report_buf[0];
-			report_buf[2] = shift_report_buf[3];
-			report_buf[3] = shift_report_buf[2];
-			report_buf[4] = ~shift_report_buf[4];
-			report_buf[5] = ~shift_report_buf[5];
+			report_buf[0][0] = shift_report_buf[1]; // mb required "turn over" descriptor
+			report_buf[0][1] = shift_report_buf[0];
+			report_buf[0][2] = shift_report_buf[3];
+			report_buf[0][3] = shift_report_buf[2];
+			report_buf[0][4] = ~shift_report_buf[4];
+			report_buf[0][5] = ~shift_report_buf[5];
+			
+			remapApply(&report_buf[0][4]); // buttons
 			
 			shift_report_buf[0] = 0;
 			shift_report_buf[1] = 0;
@@ -329,11 +332,8 @@ void main()
 			flag_report_rdy = 1;
 		}
 		
-		if((report_buf[4] != 0x00) | (report_buf[5] != 0x00)) PORT_LED ^= (1 << LED0);
+		if((report_buf[0][4] != 0x00) | (report_buf[0][5] != 0x00)) PORT_LED ^= (1 << LED0);
 		
-		if((cnt_byte == 0) & (cnt_edge == 10))
-		{
-			 usbPoll();
-		}
+		schedRun(); // one due slot
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,30 @@
+#include "remap.h"
+
+uint16_t remap_lut[4][16];
+
+void remapCompile(const uchar *map)
+{
+	uchar n, v, b;
+	uchar dst;
+	uint16_t temp;
+
+	for(n = 0; n < 4; n++)
+	{
+		for(v = 0; v < 16; v++)
+		{
+			temp = 0;
+
+			for(b = 0; b < 4; b++)
+			{
+				if((v & (1 << b)) == 0) continue;
+
+				if(map) dst = map[(n << 2) + b];
+				else dst = (n << 2) + b; // identity
+
+				if(dst < REMAP_BTN) temp |= (uint16_t)1 << dst;
+			}
+
+			remap_lut[n][v] = temp;
+		}
+	}
+}
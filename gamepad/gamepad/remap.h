@@ -0,0 +1,35 @@
+#ifndef REMAP_H_
+#define REMAP_H_
+
+#include <stdint.h>
+
+#ifndef uchar
+	#define uchar unsigned char
+#endif
+
+#define REMAP_BTN	16		/* buttons in report: 2 bytes */
+#define REMAP_NONE	0xFF	/* button in profile is not mapped to any report bit */
+
+/*********************************************************************************/
+/* profile (in config block, see "config.h"): "map[i]" - number of report bit    */
+/* (0..15) for source bit "i", at load time profile compiles to 4 tables:        */
+/*		lut[n][v] - report bits for value "v" of source nibble "n"               */
+/* so remap of any profile costs the same 4 lookups and 3 ORs                    */
+/*********************************************************************************/
+
+extern uint16_t remap_lut[4][16];
+
+void remapCompile(const uchar *map); // "map" in RAM, NULL - identity
+
+static inline void remapApply(uchar *btn) // "btn" - 2 bytes of buttons in report
+{
+	uint16_t temp;
+
+	temp = remap_lut[0][btn[0] & 0x0F] | remap_lut[1][btn[0] >> 4] |
+		   remap_lut[2][btn[1] & 0x0F] | remap_lut[3][btn[1] >> 4];
+
+	btn[0] = (uchar)temp;
+	btn[1] = (uchar)(temp >> 8);
+}
+
+#endif /* REMAP_H_ */
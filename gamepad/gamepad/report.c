@@ -0,0 +1,205 @@
+#include "report.h"
+#include "dpad.h"
+
+uchar psPresent(const uchar *frame) // absent controller: MISO pulled up, all bytes are 0xFF
+{
+	return (frame[1] != 0xFF) & (frame[2] == 0x5A);
+}
+
+uchar psCheckFrame(const uchar *frame)
+{
+	uchar len = 3 + ((frame[1] & 0x0F) << 1); // header + data words of ID
+	uchar data = 0;
+	
+	if((frame[1] == 0xFF) & (frame[2] == 0xFF)) return PS_FRAME_ABSENT;
+	
+	switch(frame[1])
+	{
+		case PS_ID_DIGITAL:
+		case PS_ID_NEGCON:
+		case PS_ID_ANALOG_JOY:
+		case PS_ID_ANALOG:
+		case PS_ID_CONFIG:
+		case PS_ID_MULTITAP:
+		case PS_ID_MOUSE:
+			break;
+		default:
+			return PS_FRAME_BAD_ID;
+	}
+	
+	if(frame[2] != 0x5A) return PS_FRAME_BAD_MARK;
+	if(frame[1] == PS_ID_MULTITAP) return PS_FRAME_OK;
+	
+	for(uchar i = 3; i < 9; i++)
+	{
+		if(i < len) data |= frame[i];
+		else if(frame[i] != 0xFF) return PS_FRAME_BAD_DATA; // nobody drives MISO after last word
+	}
+	
+	if(!data) return PS_FRAME_BAD_DATA;
+	
+	if((frame[1] == PS_ID_ANALOG) | (frame[1] == PS_ID_ANALOG_JOY)) // 4 axes: shifted or half-seated frame gives all 0x00 or 0xFF
+	{
+		uchar ax_and = frame[5] & frame[6] & frame[7] & frame[8];
+		uchar ax_or = frame[5] | frame[6] | frame[7] | frame[8];
+		
+		if((ax_and == 0xFF) | (ax_or == 0x00)) return PS_FRAME_BAD_DATA; // both sticks in the same corner: retried, then held
+	}
+	
+	return PS_FRAME_OK;
+}
+
+// fields with "ps" source are copied from frame, buttons must be inverted:
+	#define REPORT_FROM_PS(name, page, usage, bits, count, idle, ps) \
+		if(ps) \
+		{ \
+			for(uchar i = 0; i < (bits) * (count) / 8; i++) \
+				report[REPORT_OFS(name) + i] = ((bits) == 1) ? ~frame[(ps) + i] : frame[(ps) + i]; \
+		}
+
+// directions of report byte: PS - UP, RIGHT, DOWN, LEFT in bits 4..7, SEGA - nibble of "dpad.h" in bits 0..3
+	#define PS_TO_DPAD(b)	((((b) >> 4) & 0x01) | (((b) >> 5) & 0x06) | (((b) >> 2) & 0x08))
+	#define DPAD_TO_PS(n)	((((n) & 0x01) << 4) | (((n) & 0x06) << 5) | (((n) & 0x08) << 2))
+
+static inline uchar reportDpad(uchar *report, uchar player, uchar dirs) // before remap: cleaned nibble back, hat to report
+{
+	uchar res = dpadClean(player, dirs);
+	
+#ifdef DPAD_HAT
+	reportSetHAT(report, 0, res >> 4);
+#else
+	(void)report;
+#endif
+	return res & 0x0F;
+}
+
+void buildPSReport(uchar *report, const uchar *frame, uchar player)
+{
+	uchar *btn = report + REPORT_OFS(BTN);
+	
+	REPORT_FIELDS(REPORT_FROM_PS)
+	
+	btn[0] = (btn[0] & 0x0F) | DPAD_TO_PS(reportDpad(report, player, PS_TO_DPAD(btn[0])));
+	remapApply(report + REPORT_OFS(BTN));
+}
+
+uchar snesPresent(const uchar *data) // MISO pulled down: absent pad reads all "0", as if all buttons were pressed
+{
+	if((data[1] & 0xF0) == 0xF0) return 1; // SNES: 4 last bits are always "1"
+	return (data[1] == 0x00) & (data[0] != 0x00); // NES: 8 bits, then "0" of serial input; UP and DOWN can not be both pressed
+}
+
+void buildSnesReport(uchar *report, const uchar *data, uchar player) // pad data is laid out as PS frame, so remap works the same
+{
+	uchar frame[PS_FRAME_LEN];
+	uchar b = data[0];
+	uchar a = ((data[1] & 0xF0) == 0xF0) ? data[1] : 0xFF; // NES has no A, X, L, R there: its A and B are in places of B and Y
+	
+	frame[0] = 0xFF;
+	frame[1] = PS_ID_DIGITAL;
+	frame[2] = 0x5A;
+	
+	// DAT1: SELECT, L3, R3, START, UP, RIGHT, DOWN, LEFT - all active low as pad gives them
+	frame[3] = ((b >> 2) & 0x01) | 0x06 | (b & 0x18) | ((b >> 2) & 0x20) | ((b << 1) & 0xC0);
+	
+	// DAT2: L2, R2, L1 (L), R1 (R), TRIANGLE (X), CIRCLE (A), CROSS (B), SQUARE (Y)
+	frame[4] = 0x03 | (a & 0x0C) | ((a << 3) & 0x10) | ((a << 5) & 0x20) | ((b << 6) & 0xC0);
+	
+	frame[5] = REPORT_AXIS_NEUTRAL;
+	frame[6] = REPORT_AXIS_NEUTRAL;
+	frame[7] = REPORT_AXIS_NEUTRAL;
+	frame[8] = REPORT_AXIS_NEUTRAL;
+	
+	buildPSReport(report, frame, player);
+}
+
+uchar segaPresent(const uchar *gp_state_ptr) // on SEL low pad gives "LO" on D2, D3, absent port is pulled up
+{
+	return (*(gp_state_ptr + 2) & ((1 << SEGA_LF_X) | (1 << SEGA_RG_MD))) == 0;
+}
+
+// bits of PIN in SEL states 2, 3, 5 (see "state" comment in "sega_only.c"), doubled for word of both ports:
+	#define SEGA_MASK_2		((1 << SEGA_A_B) | (1 << SEGA_ST_C))	/* 0b00110000: A, START */
+	#define SEGA_MASK_3		((1 << SEGA_A_B) | (1 << SEGA_ST_C) | (1 << SEGA_UP_Z) | (1 << SEGA_DW_Y) | \
+							 (1 << SEGA_LF_X) | (1 << SEGA_RG_MD))	/* 0b00111111: B, C, directions */
+	#define SEGA_MASK_5		((1 << SEGA_UP_Z) | (1 << SEGA_DW_Y) | (1 << SEGA_LF_X) | \
+							 (1 << SEGA_RG_MD))						/* 0b00001111: Z, Y, X, MODE */
+	#define SEGA_WORD(mask)	((uint16_t)((mask) | ((mask) << 8)))
+
+void segaDecode(const uchar *gp_state, uchar *btn)
+{
+	uint16_t s2 = gp_state[2] | (gp_state[8 + 2] << 8); // 1st port - low byte, 2nd - high
+	uint16_t s3 = gp_state[3] | (gp_state[8 + 3] << 8);
+	uint16_t s5 = gp_state[5] | (gp_state[8 + 5] << 8);
+	uint16_t b0, b1;
+	
+	b0 = ((~s2 & SEGA_WORD(SEGA_MASK_2)) << 2) | (~s3 & SEGA_WORD(SEGA_MASK_3)); // bits 4, 5 go to 6, 7: no carry to other port
+	b1 = ~s5 & SEGA_WORD(SEGA_MASK_5);
+	
+	btn[0] = b0;
+	btn[1] = b1;
+	btn[2] = b0 >> 8;
+	btn[3] = b1 >> 8;
+}
+
+void buildSegaReport(uchar *report, const uchar *btn, uchar player) // no sticks on SEGA: axes stay as they are
+{
+	report[REPORT_OFS(BTN)] = (btn[0] & 0xF0) | reportDpad(report, player, btn[0] & 0x0F);
+	report[REPORT_OFS(BTN) + 1] = btn[1];
+	
+	remapApply(report + REPORT_OFS(BTN));
+}
+
+#define SATURN_NIBBLE(pin) (((~(pin)) >> SEGA_UP_Z) & 0x0F) /* D0..D3 of pad on PIN 1..4, pressed - "1" */
+
+uchar saturnPresent(const uchar *sat)
+{
+	return ((sat[0] >> SEGA_UP_Z) & 0x07) == SATURN_ID;
+}
+
+void buildSaturnReport(uchar *report, const uchar *sat, uchar player) // the same bits as "segaDecode": ST,A,C,B,R,L,D,U; R,L,MD,X,Y,Z
+{
+	report[REPORT_OFS(BTN)] = reportDpad(report, player, SATURN_NIBBLE(sat[1])) | (SATURN_NIBBLE(sat[2]) << 4); // RG LF DW UP, ST A C B
+	report[REPORT_OFS(BTN) + 1] = (SATURN_NIBBLE(sat[3]) & 0x07) | ((SATURN_NIBBLE(sat[0]) & 0x08) << 1) |
+								  ((SATURN_NIBBLE(sat[3]) & 0x08) << 2); // X Y Z, L, R
+	
+	remapApply(report + REPORT_OFS(BTN));
+}
+
+#define REPORT_FILL_IDLE(name, page, usage, bits, count, idle, ps) \
+	for(uchar i = 0; i < (bits) * (count) / 8; i++) report[REPORT_OFS(name) + i] = (idle);
+
+void buildNeutralReport(uchar *report) // controller is unplugged: nothing pressed, sticks in center
+{
+	REPORT_FIELDS(REPORT_FILL_IDLE)
+}
+
+static int16_t satAdd(int16_t acc, int8_t delta)
+{
+	if((delta > 0) & (acc > INT16_MAX - delta)) return INT16_MAX;
+	if((delta < 0) & (acc < -INT16_MAX - delta)) return -INT16_MAX; // -32768 is out of logical range
+	return acc + delta;
+}
+
+void mouseAccumulate(mouse_acc_t *acc, const uchar *frame)
+{
+	acc -> btn = ((~frame[4] >> 3) & 0x01) | ((~frame[4] >> 1) & 0x02);
+	acc -> x = satAdd(acc -> x, (int8_t)frame[5]);
+	acc -> y = satAdd(acc -> y, (int8_t)frame[6]);
+}
+
+uchar mouseDrain(mouse_acc_t *acc, uchar *report)
+{
+	if((acc -> x == 0) & (acc -> y == 0) & (acc -> btn == acc -> btn_sent)) return 0;
+	
+	report[0] = acc -> btn;
+	report[1] = acc -> x;
+	report[2] = acc -> x >> 8;
+	report[3] = acc -> y;
+	report[4] = acc -> y >> 8;
+	
+	acc -> x = 0;
+	acc -> y = 0;
+	acc -> btn_sent = acc -> btn;
+	return 1;
+}
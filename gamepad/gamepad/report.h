@@ -0,0 +1,144 @@
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include "defines.h"
+#include "remap.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef uchar
+	#define uchar unsigned char
+#endif
+
+/*********************************************************************************/
+/* layout of player report from field table (see "report_fields.h"):             */
+/*		REPORT_OFS(name)		- offset of field in report, compile time constant  */
+/*		reportSet<name>(report, i, val) - pack "i" element of field, "bits" is    */
+/*								  constant, so only one store is left after      */
+/*								  inlining (no table is read at run time)        */
+/*********************************************************************************/
+
+#define REPORT_MEMBER(name, page, usage, bits, count, idle, ps) uchar name[(bits) * (count) / 8];
+#define REPORT_ALIGN(name, page, usage, bits, count, idle, ps) \
+	typedef char report_align_##name[((bits) * (count) % 8 == 0) ? 1 : -1]; // fields are whole bytes
+
+typedef struct
+{
+	REPORT_FIELDS(REPORT_MEMBER)
+} report_layout_t;
+
+REPORT_FIELDS(REPORT_ALIGN)
+typedef char report_size_check[(sizeof(report_layout_t) == REPORT_SIZE) ? 1 : -1];
+
+#define REPORT_OFS(name) offsetof(report_layout_t, name)
+
+static inline void reportPack(uchar *field, uchar i, uint16_t val, uchar bits)
+{
+	if(bits == 1)
+	{
+		if(val) field[i >> 3] |= 1 << (i & 7);
+		else field[i >> 3] &= ~(1 << (i & 7));
+	}
+	else if(bits == 8) field[i] = (uchar)val;
+	else
+	{ // 16 bits, LSB first
+		field[i << 1] = (uchar)val;
+		field[(i << 1) + 1] = (uchar)(val >> 8);
+	}
+}
+
+#define REPORT_SETTER(name, page, usage, bits, count, idle, ps) \
+	static inline void reportSet##name(uchar *report, uchar i, uint16_t val) \
+	{ \
+		reportPack(report + REPORT_OFS(name), i, val, bits); \
+	}
+
+REPORT_FIELDS(REPORT_SETTER)
+
+/*********************************************************************************/
+/* validation of PS frame: ID from list, 0x5A marker, words after ID length are  */
+/* not driven (0xFF) and data is not all 0x00 (MISO stuck low: every button and  */
+/* both sticks in corner at once); bad frame must not go to report               */
+/*********************************************************************************/
+
+// ID of controller: high nibble - mode, low - data words after 0x5A
+	#define PS_ID_DIGITAL		0x41
+	#define PS_ID_NEGCON		0x23
+	#define PS_ID_ANALOG_JOY	0x53	/* analog joystick, "green" mode */
+	#define PS_ID_ANALOG		0x73	/* "red" mode */
+	#define PS_ID_CONFIG		0xF3	/* DualShock in config mode */
+	#define PS_ID_MULTITAP		0x80	/* slots are checked one by one as frames of own */
+	#define PS_ID_MOUSE			0x12	/* DAT2: bit 3 - left, bit 2 - right (active low), then X and Y deltas */
+
+// result of "psCheckFrame":
+	#define PS_FRAME_ABSENT		0	/* all 0xFF: MISO pulled up */
+	#define PS_FRAME_OK			1
+	#define PS_FRAME_BAD_ID		2
+	#define PS_FRAME_BAD_MARK	3
+	#define PS_FRAME_BAD_DATA	4
+
+#define PS_FRAME_BAD_COUNT 3
+
+typedef struct // diagnostics of PS port, counters saturate at 0xFFFF, see VENDOR_RQ_PS_ERRORS
+{
+	uint16_t frames;					// read by SPI, also retries
+	uint16_t bad[PS_FRAME_BAD_COUNT];	// by reason: ID, marker, data
+	uint16_t held;						// polls with all retries bad: last good report is held
+	uint16_t xfer;						// timer 1 ticks of last frame transfer, to compare PS_ENGINE
+} ps_errors_t;
+
+/*********************************************************************************/
+/* assembly of player report from raw controller data: no registers and no USB,  */
+/* so the same code runs in MC and on host ("gamepad_test/uhid_adapter")         */
+/* SOCD cleaning of "player" and remap are applied here, stamps - by caller      */
+/*********************************************************************************/
+
+// PS, "frame" - 9 bytes of answer of controller (see diagram in "main.c"):
+	uchar psPresent(const uchar *frame);
+	uchar psCheckFrame(const uchar *frame); // PS_FRAME_*
+	void buildPSReport(uchar *report, const uchar *frame, uchar player);
+
+// SNES / NES, "data" - 2 bytes of shift registers, LSB - 1st bit: B, Y, SELECT, START, UP, DOWN, LEFT, RIGHT, A, X, L, R:
+	uchar snesPresent(const uchar *data);
+	void buildSnesReport(uchar *report, const uchar *data, uchar player); // the same buttons as PS pad in the same place
+
+// SEGA, "gp_state_ptr" - 8 PIN values of port, one per SEL state (see table in "sega_only.c"):
+	uchar segaPresent(const uchar *gp_state_ptr);
+	#define SEGA_DECODE_CYCLES	56 /* budget of "segaDecode" for "isr_latency -f" after build */
+	// how it is counted (-Os code of "segaDecode" has no branches): 6 "ldd" of 3 words - 12, ALU on words (com, andi,
+	// lsl / rol for "<< 2", or) - 18, 2 "movw" of pointers - 2, 4 "st" - 8, "call" and "ret" - 8: 48 cycles,
+	// 8 are left for register moves of compiler; real code is counted on .lss by "isr_latency -f segaDecode:56"
+	
+	void segaDecode(const uchar *gp_state, uchar *btn); // both ports in one pass: "gp_state" - [2][8], "btn" - [2][2]
+	void buildSegaReport(uchar *report, const uchar *btn, uchar player); // "btn" of player: ST,A,C,B,R,L,D,U; 0,0,0,0,MD,X,Y,Z
+
+// Saturn digital pad, "sat" - SATURN_STATES PIN values of port in TH/TR states 11, 01, 10, 00 (see "saturnRead"):
+	#define SATURN_STATES	4
+	#define SATURN_ID		0x04 /* D2..D0 in state 11, MD pad can not give it: UP and DOWN at once */
+	
+	uchar saturnPresent(const uchar *sat);
+	void buildSaturnReport(uchar *report, const uchar *sat, uchar player); // MD buttons in the same places, L and R after MODE
+
+void buildNeutralReport(uchar *report); // controller is unplugged
+
+/*********************************************************************************/
+/* PS mouse: deltas of every poll are summed in 16 bit accumulators (saturated), */
+/* the sum goes in one mouse report when endpoint is free, so polls faster than  */
+/* USB lose no motion; report: buttons (bit 0 - left, 1 - right), X, Y (int16)  */
+/*********************************************************************************/
+
+#define MOUSE_REPORT_SIZE 5
+
+typedef struct
+{
+	int16_t x;
+	int16_t y;
+	uchar btn;
+	uchar btn_sent;
+} mouse_acc_t;
+
+void mouseAccumulate(mouse_acc_t *acc, const uchar *frame);
+uchar mouseDrain(mouse_acc_t *acc, uchar *report); // 1 - report has motion or new buttons
+
+#endif /* REPORT_H_ */
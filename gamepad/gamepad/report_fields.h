@@ -0,0 +1,124 @@
+#ifndef REPORT_FIELDS_H_
+#define REPORT_FIELDS_H_
+
+/****************************************************************************************************/
+/* single source of player report: descriptor bytes ("descriptor.h"), their length                 */
+/* (USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH), REPORT_SIZE, offsets and packers ("report.h") are all   */
+/* generated from REPORT_FIELDS by preprocessor, so layout can not drift from descriptor           */
+/* only macros here: file is included in asm through "usbconfig.h"                                 */
+/*                                                                                                  */
+/* F(name, page, usage, bits, count, idle, ps):                                                     */
+/*		page	- DESKTOP, BUTTON, VENDOR or HAT (DESKTOP usage: logical max 7, null state)         */
+/*		usage	- usage in page, for BUTTON - 1st button of "count" buttons in a row                */
+/*		bits	- 1, 8 or 16 (logical max is 2^bits - 1), field takes "bits * count / 8" bytes     */
+/*		idle	- byte value of field when controller is absent                                     */
+/*		ps		- 1st byte of PS frame for field (1-bit fields are active low there), 0 - not from PS */
+/****************************************************************************************************/
+
+#define DPAD_HAT_NULL 0x08 /* hat is released */
+
+#ifdef DPAD_HAT // directions after SOCD cleaning, see "dpad.h"
+	#define REPORT_FIELD_HAT(F) F(HAT,	HAT,	0x39,	8,	1,	DPAD_HAT_NULL,	0)
+#else
+	#define REPORT_FIELD_HAT(F)
+#endif
+
+#define REPORT_FIELDS_COMMON(F) \
+	F(BTN,	BUTTON,		0x01,	1,	16,	0x00,				3) \
+	F(X,	DESKTOP,	0x30,	8,	1,	REPORT_AXIS_NEUTRAL,	5) \
+	F(Y,	DESKTOP,	0x31,	8,	1,	REPORT_AXIS_NEUTRAL,	6) \
+	REPORT_FIELD_HAT(F)
+
+#ifdef REPORT_STAMP // vendor fields instead of right stick, see "stamp.h"
+	#define REPORT_FIELDS(F) REPORT_FIELDS_COMMON(F) \
+		F(SEQ,	VENDOR,		0x02,	8,	1,	0x00,	0) /* + 1 for every new report, gap on host - lost report */ \
+		F(TIME,	VENDOR,		0x03,	16,	1,	0x00,	0) /* timer 1 cnt when sample was latched, LSB first */ \
+		F(SOF,	VENDOR,		0x04,	8,	1,	0x00,	0) /* "usbSofCount" when sample was latched */
+#else
+	#define REPORT_FIELDS(F) REPORT_FIELDS_COMMON(F) \
+		F(RX,	DESKTOP,	0x33,	8,	1,	REPORT_AXIS_NEUTRAL,	7) \
+		F(RY,	DESKTOP,	0x34,	8,	1,	REPORT_AXIS_NEUTRAL,	8)
+#endif
+
+/*********************************************************************************/
+/*                        items of descriptor for one field                      */
+/*********************************************************************************/
+
+#define HID_PAGE_DESKTOP		0x05, 0x01			/* USAGE_PAGE (Generic Desktop) */
+#define HID_PAGE_BUTTON			0x05, 0x09			/* USAGE_PAGE (Button) */
+#define HID_PAGE_VENDOR			0x06, 0x00, 0xFF	/* USAGE_PAGE (Vendor Defined) */
+#define HID_PAGE_HAT			HID_PAGE_DESKTOP
+#define HID_PAGE_LEN_DESKTOP	2
+#define HID_PAGE_LEN_BUTTON		2
+#define HID_PAGE_LEN_VENDOR		3
+#define HID_PAGE_LEN_HAT		2
+
+#define HID_USAGE_DESKTOP(usage, count)	0x09, (usage)								/* USAGE */
+#define HID_USAGE_BUTTON(usage, count)	0x19, (usage), 0x29, ((usage) + (count) - 1)	/* USAGE_MINIMUM, USAGE_MAXIMUM */
+#define HID_USAGE_VENDOR(usage, count)	0x09, (usage)
+#define HID_USAGE_HAT(usage, count)		0x09, (usage)
+#define HID_USAGE_LEN_DESKTOP	2
+#define HID_USAGE_LEN_BUTTON	4
+#define HID_USAGE_LEN_VENDOR	2
+#define HID_USAGE_LEN_HAT		2
+
+#define HID_LMAX_1				0x25, 0x01							/* LOGICAL_MAXIMUM (1) */
+#define HID_LMAX_8				0x26, 0xFF, 0x00					/* LOGICAL_MAXIMUM (255) */
+#define HID_LMAX_16				0x27, 0xFF, 0xFF, 0x00, 0x00		/* LOGICAL_MAXIMUM (65535) */
+#define HID_LMAX_LEN_1			2
+#define HID_LMAX_LEN_8			3
+#define HID_LMAX_LEN_16			5
+
+// logical max by page: by "bits", for hat - 7 directions
+	#define HID_LMAX_DESKTOP(bits)		HID_LMAX_##bits
+	#define HID_LMAX_BUTTON(bits)		HID_LMAX_##bits
+	#define HID_LMAX_VENDOR(bits)		HID_LMAX_##bits
+	#define HID_LMAX_HAT(bits)			0x25, 0x07	/* LOGICAL_MAXIMUM (7) */
+	#define HID_LMAX_LEN_DESKTOP(bits)	HID_LMAX_LEN_##bits
+	#define HID_LMAX_LEN_BUTTON(bits)	HID_LMAX_LEN_##bits
+	#define HID_LMAX_LEN_VENDOR(bits)	HID_LMAX_LEN_##bits
+	#define HID_LMAX_LEN_HAT(bits)		2
+
+#define HID_INPUT_DESKTOP	0x02	/* INPUT (Data,Var,Abs) */
+#define HID_INPUT_BUTTON	0x02
+#define HID_INPUT_VENDOR	0x02
+#define HID_INPUT_HAT		0x42	/* INPUT (Data,Var,Abs,Null) */
+
+#define HID_FIELD_ITEMS(name, page, usage, bits, count, idle, ps) \
+	HID_PAGE_##page, \
+	HID_USAGE_##page(usage, count), \
+	0x15, 0x00,				/* LOGICAL_MINIMUM (0) */ \
+	HID_LMAX_##page(bits), \
+	0x75, (bits),			/* REPORT_SIZE */ \
+	0x95, (count),			/* REPORT_COUNT */ \
+	0x81, HID_INPUT_##page,	/* INPUT */
+
+#define HID_FIELD_LEN(name, page, usage, bits, count, idle, ps) \
+	+ HID_PAGE_LEN_##page + HID_USAGE_LEN_##page + 2 + HID_LMAX_LEN_##page(bits) + 6
+
+// around fields: USAGE_PAGE, USAGE (Game Pad), COLLECTION - 6 bytes; config feature - 16 bytes; END_COLLECTION - 1 byte
+	#define REPORT_DESCR_LEN	(6 REPORT_FIELDS(HID_FIELD_LEN) + 16 + 1)
+
+/*********************************************************************************/
+/*                               report size                                     */
+/*********************************************************************************/
+
+#define REPORT_FIELD_SIZE(name, page, usage, bits, count, idle, ps)	+ (bits) * (count) / 8
+#define REPORT_FIELD_DATA(name, page, usage, bits, count, idle, ps)	+ REPORT_IS_DATA_##page * (bits) * (count) / 8
+#define REPORT_IS_DATA_DESKTOP	1
+#define REPORT_IS_DATA_BUTTON	1
+#define REPORT_IS_DATA_VENDOR	0
+#define REPORT_IS_DATA_HAT		1
+
+#define REPORT_SIZE			(0 REPORT_FIELDS(REPORT_FIELD_SIZE)) /* per player */
+#define REPORT_DATA_SIZE	(0 REPORT_FIELDS(REPORT_FIELD_DATA)) /* buttons and axes without vendor fields */
+
+#if REPORT_SIZE > 8
+	#error "report does not fit 8 byte packet of low speed interrupt endpoint"
+#endif
+
+#if REPORT_DESCR_LEN > 255
+	#error "report descriptor is longer than 255 bytes"
+#endif
+
+#endif /* REPORT_FIELDS_H_ */
@@ -0,0 +1,77 @@
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include "defines.h"
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#ifndef uchar
+	#define uchar unsigned char
+#endif
+
+/*********************************************************************************/
+/* time-triggered cyclic executive of main loop: one tick source - timer 1       */
+/* (free-running, US_TO_TICK) and static slot table of firmware:                 */
+/*		S(name, period_us, phase_us, wcet_us, task)                              */
+/*		phase_us	- first release after "schedInit", less than period          */
+/*		wcet_us		- declared worst case of "task"                              */
+/* main loop calls "usbPoll", then "schedRun": first due slot in table order     */
+/* runs, one slot per pass, so time between "usbPoll" calls is bounded by        */
+/* declared worst cases, preprocessor checks it by SCHED_WCET_SUM (as if all     */
+/* slots were due at once) against SCHED_USB_GAP_US                              */
+/* late slot (memory card transfer, long SETUP) skips missed periods, they do    */
+/* not run in a burst; no timer interrupts: every task runs in main loop         */
+/*********************************************************************************/
+
+#define SCHED_ENUM(name, period_us, phase_us, wcet_us, task)	SCHED_##name,
+#define SCHED_PERIOD(name, period_us, phase_us, wcet_us, task)	US_TO_TICK(period_us),
+#define SCHED_SUM(name, period_us, phase_us, wcet_us, task)		+ (wcet_us)
+#define SCHED_BAD(name, period_us, phase_us, wcet_us, task) \
+	|| (US_TO_TICK(period_us) < 1) || (US_TO_TICK(period_us) > 32767) || ((phase_us) >= (period_us))
+
+#define SCHED_WCET_SUM(slots)	(0 slots(SCHED_SUM))
+#define SCHED_TABLE_BAD(slots)	(0 slots(SCHED_BAD)) /* period out of half of timer 1 wrap or phase out of period */
+
+#define SCHED_INIT(name, period_us, phase_us, wcet_us, task) \
+	sched_next[SCHED_##name] = now + US_TO_TICK(phase_us);
+
+#define SCHED_DISPATCH(name, period_us, phase_us, wcet_us, task) \
+	if((int16_t)(now - sched_next[SCHED_##name]) >= 0) \
+	{ \
+		sched_next[SCHED_##name] += US_TO_TICK(period_us); \
+		if((int16_t)(now - sched_next[SCHED_##name]) >= 0) sched_next[SCHED_##name] = now + US_TO_TICK(period_us); \
+		task(); \
+		return; \
+	}
+
+// slot enum, release times and calls for table "slots" (one firmware - one table):
+	#define SCHED_DEFINE(slots) \
+		enum { slots(SCHED_ENUM) SCHED_COUNT }; \
+		\
+		static uint16_t sched_next[SCHED_COUNT]; /* timer 1 cnt of next release */ \
+		static const uint16_t sched_period[SCHED_COUNT] = { slots(SCHED_PERIOD) }; \
+		\
+		static inline void schedInit() /* after timer 1 is started */ \
+		{ \
+			uint16_t now = TCNT1; \
+			slots(SCHED_INIT) \
+		} \
+		\
+		static inline void schedRun() \
+		{ \
+			uint16_t now = TCNT1; \
+			slots(SCHED_DISPATCH) \
+		} \
+		\
+		static inline void schedRestart(uchar slot) /* next release in full period from now */ \
+		{ \
+			sched_next[slot] = TCNT1 + sched_period[slot]; \
+		} \
+		\
+		static inline void schedAfter(uchar slot, uint16_t ticks) /* from its task: next release "ticks" after this one, not period */ \
+		{ \
+			sched_next[slot] += ticks - sched_period[slot]; \
+		}
+
+#endif /* SCHED_H_ */
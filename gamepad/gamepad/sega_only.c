@@ -3,16 +3,34 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
+#include <string.h>
 
 #include "usbdrv/usbdrv.h"
+#include "remap.h"
+#include "dpad.h"
+#include "config.h"
+#include "presence.h"
+#include "stamp.h"
+#include "report.h"
+#include "trace.h"
+#include "vendor.h"
+#include "history.h"
+#include "sched.h"
 #include "descriptor.h"
 
-uchar report_buf[REPORT_SIZE] = {0x00, 0x00, 0x00}; // ???
+#ifdef PS_MOUSE
+	#error "PS_MOUSE is not supported: mouse is on PS port, use main.c"
+#endif
+
+uchar report_buf[PLAYERS][REPORT_SIZE]; // one report per interface: 1st player - EP1, 2nd - EP3, no sticks on SEGA
 	
 uchar delay_idle = INIT_IDLE_TIME; // step - 4ms
 uchar cnt_idle = 0;
 
-uchar state = 0; // 0..7 states
+uchar state = 0; // 0..7 states, 8 - delay between packets
+uint16_t sel_per_poll, sel_btw_poll; // timer 1 ticks of "cfg" durations, see "configApply"
+uint16_t sel_mark; // state 8: TCNT1 of last passed delay (or of packet end)
+uchar gp_state_buf[2][8]; // packet of both ports, state is sampled right before SEL front to next one
 /*  _____________________________
 	|Sel |D0 |D1 |D2 |D3 |D4 |D5 |
 	+----+---+---+---+---+---+---+
@@ -31,13 +49,33 @@ uchar state = 0; // 0..7 states
 /*		   state:	0 1 2 3 ... 7 | 8 | 0 1 2 3 ...						*/
 /*					  _   _	    _	      _   _							*/
 /*		SEL:	 ____/ \_/ \_... \_______/ \_/ \_...					*/
+/*		sample:		 ^ ^ ^ ^	 ^		 ^ ^ ^	(before every front)   */
 /************************************************************************/
 
-uchar flag_ch_gp = 1; // shows that required save buttons state
 uchar flag_report = 0;
 uchar flag_idle = 0; // shows that idle time is over and can send report
+uchar flag_report_rdy[PLAYERS] = {0, 0}; // report of player is built and not sent yet
 
-USB_PUBLIC uchar usbFunctionDescriptor(usbRequest_t * rq)
+// presence: SEL is common for both ports, so SEL packets go rarer only when both ports are absent
+	port_state_t sega_port[2] = {{0, 0}, {0, 0}};
+	uchar sega_backoff = 0; // least "backoff" of ports
+	uchar cnt_btw = 0; // delays between packets passed
+	
+#ifdef SEGA_PCINT
+	volatile uchar flag_wake = 0; // data line has changed between packets: next packet goes at once
+	uchar sega_idle = 0; // backoff of present ports with no change, up to SEGA_IDLE_BACKOFF
+	uchar sega_last[2][8]; // previous packet
+#endif
+	
+	stamp_t sega_stamp; // when last state of packet was latched (REPORT_STAMP), common for both ports
+	uchar report_seq = 0;
+	
+#ifdef SATURN_PAD
+	uchar sat_buf[2][SATURN_STATES];
+	uchar sat_found = 0; // bit per port: Saturn pad gave its ID in last burst
+#endif
+
+USB_PUBLIC usbMsgLen_t usbFunctionDescriptor(usbRequest_t * rq)
 {
 	if (rq->bRequest == USBRQ_GET_DESCRIPTOR)
 	{
@@ -61,17 +99,31 @@ USB_PUBLIC uchar usbFunctionDescriptor(usbRequest_t * rq)
 	return 0x00;
 }
 
-USB_PUBLIC uchar usbFunctionSetup(uchar data[8])
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8])
 {
 	usbRequest_t *rq = (usbRequest_t*)data;
 	
+	#ifdef HISTORY
+		historyCancel(); // new SETUP: previous control transfer is over
+	#endif
+	
 	if((rq -> bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS) // class request type
 	{    
+		TRACE_EVENT(TRACE_ID_SETUP, rq -> bRequest);
+		
 		switch (rq -> bRequest)
 		{
 			case USBRQ_HID_GET_REPORT:
-				usbMsgPtr = (usbMsgPtr_t)report_buf;
+				if(rq -> wValue.bytes[1] == HID_REPORT_FEATURE) return configSetup(rq); // call "usbFunctionRead"
+				
+				if(rq -> wIndex.bytes[0] < PLAYERS) // interface number <=> player
+					usbMsgPtr = (usbMsgPtr_t)report_buf[rq -> wIndex.bytes[0]];
+				else
+					usbMsgPtr = (usbMsgPtr_t)report_buf[0];
 				return REPORT_SIZE;
+			case USBRQ_HID_SET_REPORT:
+				if(rq -> wValue.bytes[1] == HID_REPORT_FEATURE) return configSetup(rq); // call "usbFunctionWrite" ("OUT" token)
+				break;
 			case USBRQ_HID_GET_IDLE:
 				if (rq -> wValue.bytes[0] > 0)
 				{
@@ -81,45 +133,129 @@ USB_PUBLIC uchar usbFunctionSetup(uchar data[8])
 				break;
 			//case USBRQ_HID_SET_IDLE: return USB_NO_MSG; // call "usbFunctionWrite" ("OUT" token)
 			case USBRQ_HID_SET_IDLE:
-				// mb required reset "cnt_idle" and enable interrupt timer 0, cause 
+				// mb required reset "cnt_idle" and restart of IDLE slot, cause 
 				// "flag_idle" can be set during "delay_idle" change in large way
 				if(rq -> wValue.bytes[1] != 0) delay_idle = rq -> wValue.bytes[1];
-				else delay_idle = 3; // when the upper byte of "wValue" = 0, the duration is indefinite
+				else delay_idle = cfg.delay_idle; // when the upper byte of "wValue" = 0, the duration is indefinite
+				break;
 		}
 	}
+#ifdef HISTORY
+	else if(((rq -> bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_VENDOR) & (rq -> bRequest == VENDOR_RQ_HISTORY))
+		return historySetup(rq); // call "usbFunctionRead", see "vendor.h"
+#endif
 	
 	return 0; // ignore data from host ("OUT" token)
 }
 
-/*
-USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len)
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len) // SET_FEATURE: config block
 {
-	usbRequest_t *rq = (usbRequest_t*)data;
+	uchar res = configWrite(data, len);
 	
-	if(rq -> wValue.bytes[1] != 0) delay_idle = rq -> wValue.bytes[1];
-	else delay_idle = 0; // when the upper byte of "wValue" = 0, the duration is indefinite
+	if(res == 1) configApply(); // new config works at once, without re-enumeration
+	return res;
+}
+
+USB_PUBLIC uchar usbFunctionRead(uchar *data, uchar len) // GET_FEATURE: config block, or history
+{
+	#ifdef HISTORY
+		if(historyOwnsData()) return historyRead(data, len);
+	#endif
 	
-	return 1;
+	return configRead(data, len);
 }
-*/
 
-uchar *updReportBuf(uchar offset, uchar *gp_state_ptr) // offset defines by player number: 1st - "0", 2nd - "8"
+void configApply() // limits of SEL timings are checked in "configValid"
 {
-	static uchar int_report_buf[2]; // internal report buf - 0 byte: ST,A,C,B,R,L,D,U; 1 byte: 0,0,0,0,MD,X,Y,Z
-	uchar temp;
+	sel_per_poll = US_TO_TICK(cfg.per_poll_gp_us); // SEL slot counts ticks, not us
+	sel_btw_poll = US_TO_TICK(cfg.delay_btw_poll_us);
+	delay_idle = cfg.delay_idle;
+	remapCompile(cfg.remap);
+	dpadCompile(cfg.dpad_mode);
+	HISTORY_DIRS(remap_lut[0][0x0F]); // SEGA directions: bits 0..3 of 1st byte before remap
+}
+
+#ifdef SATURN_PAD
+
+/*********************************************************************************/
+/* Saturn digital pad through adapter: TH - SEL (common), TR - PIN 9 of port,    */
+/* nibble on PIN 1..4; all 4 TH/TR states go in one burst (~ 4 * settle time)    */
+/* right after MD packet, both ports at once; MD pad gets 2 more SEL edges and   */
+/* resets its counter in the rest of delay between packets                       */
+/*		TH TR:	1 1		|	0 1			|	1 0			|	0 0                  */
+/*		D3..D0:	L  ID	|	RG LF DW UP	|	ST A  C  B	|	R  X  Y  Z           */
+/* TR is driven only on port where pad gave SATURN_ID in state 11: MD pad also   */
+/* drives PIN 9, so there it stays input with pull up                            */
+/*********************************************************************************/
+
+void saturnRead()
+{
+	uchar tr1, tr2;
+	
+	PORT_SEGA_AUX |= (1 << SEGA_SEL); // TH = 1, TR = 1
+	_delay_us(SATURN_SETTLE_US);
+	sat_buf[0][0] = PIN_SEGA1;
+	sat_buf[1][0] = PIN_SEGA2;
 	
-	// 2,3,5 - SEL number at which data were polling in protocol (see "state" comment)
-	temp = (~(*(gp_state_ptr + 2 + offset))) & ((1 << SEGA_A_B) | (1 << SEGA_ST_C));	// 0b00110000
-	int_report_buf[0] = temp << 2;
+	tr1 = saturnPresent(sat_buf[0]) ? (1 << SEGA_ST_C) : 0;
+	tr2 = saturnPresent(sat_buf[1]) ? (1 << SEGA_ST_C) : 0;
+	
+	PORT_SEGA_AUX &= ~(1 << SEGA_SEL); // TH = 0, TR = 1
+	_delay_us(SATURN_SETTLE_US);
+	sat_buf[0][1] = PIN_SEGA1;
+	sat_buf[1][1] = PIN_SEGA2;
+	
+// TR = 0: pull up off, then output low
+	PORT_SEGA1 &= ~tr1;
+	PORT_SEGA2 &= ~tr2;
+	DDR_SEGA1 |= tr1;
+	DDR_SEGA2 |= tr2;
+	
+	PORT_SEGA_AUX |= (1 << SEGA_SEL); // TH = 1, TR = 0
+	_delay_us(SATURN_SETTLE_US);
+	sat_buf[0][2] = PIN_SEGA1;
+	sat_buf[1][2] = PIN_SEGA2;
+	
+	PORT_SEGA_AUX &= ~(1 << SEGA_SEL); // TH = 0, TR = 0
+	_delay_us(SATURN_SETTLE_US);
+	sat_buf[0][3] = PIN_SEGA1;
+	sat_buf[1][3] = PIN_SEGA2;
+	
+// TR = 1: input, then pull up
+	DDR_SEGA1 &= ~tr1;
+	DDR_SEGA2 &= ~tr2;
+	PORT_SEGA1 |= tr1;
+	PORT_SEGA2 |= tr2;
+	
+	sat_found = (tr1 != 0) | ((tr2 != 0) << 1);
+	if(sat_found) stampTake(&sega_stamp); // burst is the last sample of packet
+}
 
-	temp = (~(*(gp_state_ptr + 3 + offset))) & ((1 << SEGA_A_B) | (1 << SEGA_ST_C) | (1 << SEGA_UP_Z) | (1 << SEGA_DW_Y) |
-												(1 << SEGA_LF_X) | (1 << SEGA_RG_MD));	// 0b00111111
-	int_report_buf[0] |= temp;
+#endif
 
-	temp = (~(*(gp_state_ptr + 5 + offset))) & ((1 << SEGA_UP_Z) | (1 << SEGA_DW_Y) | (1 << SEGA_LF_X) | (1 << SEGA_RG_MD));	// 0b00001111
-	int_report_buf[1] = temp;
+void updPresence(uchar *gp_state_ptr)
+{
+#ifdef SATURN_PAD
+	portUpdate(&sega_port[0], segaPresent(gp_state_ptr) | (sat_found & 0x01));
+	portUpdate(&sega_port[1], segaPresent(gp_state_ptr + 8) | (sat_found >> 1));
+#else
+	portUpdate(&sega_port[0], segaPresent(gp_state_ptr));
+	portUpdate(&sega_port[1], segaPresent(gp_state_ptr + 8));
+#endif
+	
+	if(sega_port[0].backoff < sega_port[1].backoff) sega_backoff = sega_port[0].backoff;
+	else sega_backoff = sega_port[1].backoff;
 	
-	return int_report_buf; // return pointer on massive
+#ifdef SEGA_PCINT
+	if(memcmp(sega_last, gp_state_ptr, sizeof(sega_last)) != 0)
+	{
+		memcpy(sega_last, gp_state_ptr, sizeof(sega_last));
+		sega_idle = 0;
+	}
+	else if(sega_idle < SEGA_IDLE_BACKOFF) sega_idle++;
+	
+	if(sega_backoff < sega_idle) sega_backoff = sega_idle; // absent ports are probed as before, idle pads wake by PCINT
+#endif
 }
 
 void hardwareInit()
@@ -138,123 +274,230 @@ void hardwareInit()
 	//DDR_PS =
 	//PORT_PS =
 		
-	// timers:
-	TCCR0A = (1 << WGM01); // CTC mode with OCRA
-	TCCR0B = (1 << CS02); // presc = 256 => 4 ms <=> 250 cnt
-	OCR0A = STEP_IDLE_CONF;
-		
-	TCCR2A = (1 << WGM21); // CTC mode with OCRA
-	TCCR2B = (1 << CS20) | (1 << CS22); // presc = 128 => 2 ms <=> 250 cnt; 500 us <=> 62.5
-	OCR2A = PER_POLL_GP;
-		
-	TIMSK0 = (1 << OCIE0A);
-	TIMSK2 = (1 << OCIE2A);
+	// timers (0 and 2 are free: SEL fronts and idle steps go in cyclic executive, see "sched.h"):
+	TCCR1B = TICK_T1_CS; // free-running time base for SEL, report stamps and cyclic executive
 }
 
-ISR(TIMER0_COMPA_vect)
+#ifdef SEGA_PCINT
+
+/*********************************************************************************/
+/* between packets SEL is low and pad shows UP, DW, A, ST (state 0 of table):    */
+/* pin change interrupt on data lines of both ports is armed after packet is     */
+/* taken, so press waits ~ SEL_RESET_US instead of full delay with backoff;      */
+/* other buttons are seen by packets at full rate (SEGA_IDLE_BACKOFF 0)          */
+/*		 SEL:	_/~\_/~\_ ... _/~\___________/~\_/~\_ ...                        */
+/*						  armed ^  ^ change: packet at once (>= SEL_RESET_US)    */
+/*********************************************************************************/
+
+void armPCINT() // call in main loop when packet is taken
 {
-	TIMSK2 &= ~(1 << OCIE2A); // "cli" for avoid nested interrupts
-		sei();
-		
-		if(cnt_idle < delay_idle) cnt_idle++;
-		else
+	if(state == 8)
+	{
+		PCMSK0 = SEGA_PIN_MASK; // PB0..5 - PCINT0..5
+		PCMSK1 = SEGA_PIN_MASK; // PC0..5 - PCINT8..13
+		PCIFR = (1 << PCIF0) | (1 << PCIF1); // edges of packet are over
+		PCICR = (1 << PCIE0) | (1 << PCIE1);
+	}
+}
+
+ISR(PCINT0_vect) // both ports: SEL slot starts packet at its next check, no timer is touched here
+{
+	PCICR = 0; // once per delay
+	flag_wake = 1;
+}
+
+ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect));
+
+#endif
+
+/*********************************************************************************/
+/* tasks of cyclic executive (see "sched.h"): SEL slot makes packets on timer 1  */
+/* tick, was timer 2 interrupt; slot sets its own next release ("schedAfter"),   */
+/* front late by pass of main loop only shortens next half period a bit          */
+/*********************************************************************************/
+
+void taskIdle() // one step of USB idle time, was timer 0 interrupt
+{
+	if(cnt_idle < delay_idle) cnt_idle++;
+	else flag_idle = 1;
+}
+
+void taskHouse()
+{
+	configPoll(); // background EEPROM write
+}
+
+void taskSel(); // after slot table: it sets its own next release
+
+// slots: first due one in table order runs
+	#define SCHED_SLOTS(S) \
+		S(SEL,		PER_POLL_GP_US,	0,					SCHED_SEL_WCET_US,		taskSel) \
+		S(IDLE,		STEP_IDLE_US,	0,					SCHED_IDLE_WCET_US,		taskIdle) \
+		S(HOUSE,	SCHED_HOUSE_US,	SCHED_HOUSE_US / 2,	SCHED_HOUSE_WCET_US,	taskHouse)
+
+SCHED_DEFINE(SCHED_SLOTS)
+
+#if SCHED_TABLE_BAD(SCHED_SLOTS)
+	#error "SCHED_SLOTS: period does not fit timer 1 or phase is out of period"
+#endif
+
+// SEL front waits at most pass with other slot: its own worst case is not in delay
+#if SCHED_WCET_SUM(SCHED_SLOTS) - SCHED_SEL_WCET_US + SCHED_USB_WCET_US > PER_POLL_GP_MIN_US - DELAY_BEF_POLL_US
+	#error "SCHED_SLOTS: SEL front late by pass of main loop leaves less than DELAY_BEF_POLL_US for buttons to settle"
+#endif
+
+uchar selDelayOver() // state 8: SEL is low, absent or idle ports wait 2^"sega_backoff" delays
+{
+	uint16_t waited = TCNT1 - sel_mark;
+	
+	if(waited >= sel_btw_poll)
+	{
+		sel_mark += sel_btw_poll;
+		waited -= sel_btw_poll;
+		cnt_btw++;
+	}
+	
+	#ifdef SEGA_PCINT
+		if(flag_wake & ((cnt_btw != 0) | (waited >= SEL_RESET))) return 1; // pad counter must reset before packet
+	#endif
+	
+	return cnt_btw >= (1 << sega_backoff);
+}
+
+void taskSel() // sample of state and SEL front to next one, or check of delay between packets
+{
+	if(state == 8)
+	{
+		if(!selDelayOver())
 		{
-			TIMSK0 &= ~(1 << OCIE0A);
-			flag_idle = 1;
+			schedAfter(SCHED_SEL, SEL_WAIT_STEP);
+			return;
 		}
-	TIMSK2 |= (1 << OCIE2A); // "sei"
+		
+		#ifdef SEGA_PCINT
+			PCICR = 0; // SEL goes on: lines change by protocol
+			flag_wake = 0;
+		#endif
+		
+		cnt_btw = 0;
+		state = 0; // SEL was low for whole delay: state 0 is sampled at once
+	}
+	
+	gp_state_buf[0][state] = PIN_SEGA1 & SEGA_PIN_MASK;
+	gp_state_buf[1][state] = PIN_SEGA2 & SEGA_PIN_MASK;
+	stampTake(&sega_stamp); // last take in packet (state 7) stays
+	
+	if(state < 7)
+	{
+		PORT_SEGA_AUX ^= (1 << SEGA_SEL);
+		state++;
+		schedAfter(SCHED_SEL, sel_per_poll);
+	}
+	else
+	{ // end of packet:
+		PORT_SEGA_AUX &= ~(1 << SEGA_SEL);
+		sel_mark = TCNT1;
+		flag_report = 1;
+		state = 8;
+		schedAfter(SCHED_SEL, SEL_WAIT_STEP);
+	}
 }
 
-ISR(TIMER2_COMPA_vect)
+void sendReports() // send report immediately after "idle" time has passed, players go independently on own endpoints
 {
-	TIMSK0 &= ~(1 << OCIE0A); // "cli"
-		sei();
+	uchar sent = 0;
 	
-		if(state < 7) 
-		{
-			PORT_SEGA_AUX ^= (1 << SEGA_SEL);
+	if(flag_report_rdy[0] && usbInterruptIsReady())
+	{
+		usbSetInterrupt(HISTORY_SEND(0, report_buf[0]), REPORT_SIZE);  // ~ 18.06 us, with sticky presses
 		
-			flag_ch_gp = 1;
-			state++;
-		}
-		else if(state == 8)
-		{ // after delay between "packets":
-			OCR2A = PER_POLL_GP;
-			flag_ch_gp = 1;
-			state = 0;
-		}
-		else
-		{ // after "packet":
-			PORT_SEGA_AUX &= ~(1 << SEGA_SEL);
-			OCR2A = DELAY_BTW_POLL;
+		TRACE_EVENT(TRACE_ID_REPORT, 0);
+		flag_report_rdy[0] = 0;
+		sent = 1;
+	}
+	
+	if(flag_report_rdy[1] && usbInterruptIsReady3())
+	{
+		usbSetInterrupt3(HISTORY_SEND(1, report_buf[1]), REPORT_SIZE);
 		
-			flag_report = 1;
-			state = 8;
-		}
-	TIMSK0 |= (1 << OCIE0A); // "sei"
+		TRACE_EVENT(TRACE_ID_REPORT, 1);
+		flag_report_rdy[1] = 0;
+		sent = 1;
+	}
+	
+	if(sent & !(flag_report_rdy[0] | flag_report_rdy[1])) // endpoint was busy: its report goes on next pass
+	{
+		cnt_idle = 0;
+		flag_idle = 0;
+		schedRestart(SCHED_IDLE); // idle steps go from now
+		
+		PORT_LED ^= (1 << LED1);
+	}
 }
 
 void main(void)
 {
-	uchar gp_state_buf[2][8];
-	uchar *report_buf_ptr;
+	uchar sega_btn[2][2]; // both ports decoded at once
 
+	configLoad();
+	configApply();
+	
+	for(uchar i = 0; i < PLAYERS; i++) buildNeutralReport(report_buf[i]);
+	
 	hardwareInit();
+	
 	usbDeviceConnect();
 	usbInit();
 	
-// full reset timers:
-	TCNT0 = 0;
-	TCNT2 = 0;
+	TCNT1 = 0;
+	schedInit();
 	
-	// reset interrupt timers flags:
-	TIFR0 |= (1 << OCF0A);
-	TIFR2 |= (1 << OCF2A); 
-	
-	GTCCR |= (1 << PSRASY); // reset presc timers
+	#ifdef TRACE_USART
+		traceInit();
+	#endif
 	
 	sei();
     while (1) 
     {
 		usbPoll(); // ~ 9.63 us (all timings write in 16 MHz CPU freq)
+		schedRun(); // one due slot
 		
-		if(flag_idle) // send report immediately after "idle" time has passed:
-		{
-			if(usbInterruptIsReady())
-			{
-				usbSetInterrupt(report_buf, REPORT_SIZE);  // ~ 18.06 us
-				
-				cnt_idle = 0;
-				flag_idle = 0;
-				
-				PORT_LED ^= (1 << LED1);
-				
-			// full reset timer 0 then enable interrupt:
-				TCNT0 = 0;
-				TIFR0 |= (1 << OCF0A); 
-				TIMSK0 |= (1 << OCIE0A);
-			}
-		}
+		if(flag_idle) sendReports();
 		
 		if(flag_report) // build report:
 		{ 
-			report_buf_ptr = updReportBuf(0, (uchar *)gp_state_buf); // var that defining the array is also a pointer to it
-				report_buf[0] = *report_buf_ptr;
-				report_buf[1] = *(report_buf_ptr + 1);
-				report_buf[1] <<= 4;
+			#ifdef SATURN_PAD
+				saturnRead(); // SEL is low until end of delay between packets
+			#endif
+			
+			updPresence((uchar *)gp_state_buf);
+			report_seq++;
+			
+			TRACE_EVENT(TRACE_ID_SEL_END, sega_port[0].present | (sega_port[1].present << 1));
+			STREAM_FRAME(STREAM_ID_SEGA, (uchar *)gp_state_buf, STREAM_SEGA_LEN, sega_stamp.time);
+			
+			segaDecode((uchar *)gp_state_buf, (uchar *)sega_btn);
+			
+			for(uchar i = 0; i < PLAYERS; i++)
+			{
+				#ifdef SATURN_PAD
+					if(sat_found & (1 << i)) buildSaturnReport(report_buf[i], sat_buf[i], i);
+					else
+				#endif
+				if(sega_port[i].present) buildSegaReport(report_buf[i], sega_btn[i], i);
+				else buildNeutralReport(report_buf[i]); // unplugged player - neutral state
 				
-			report_buf_ptr = updReportBuf(8, (uchar *)gp_state_buf);
-				report_buf[1] |= *(report_buf_ptr + 1);
-				report_buf[2] = *report_buf_ptr;
+				stampReport(report_buf[i], report_seq, &sega_stamp);
+				HISTORY_SAMPLE(i, report_buf[i], sega_stamp.time);
+				flag_report_rdy[i] = 1; // every packet: endpoint that was busy gets newest report
+			}
 			
 			flag_report = 0;
-		}
-		
-		if(flag_ch_gp & (TCNT2 >= DELAY_BEF_POLL)) // upd gamepad status buffer:
-		{
-			gp_state_buf[0][state] = PIN_SEGA1 & SEGA_PIN_MASK;
-			gp_state_buf[1][state] = PIN_SEGA2 & SEGA_PIN_MASK;
-			flag_ch_gp = 0;
+			
+			#ifdef SEGA_PCINT
+				if(sega_idle == 0) flag_idle = 1; // new buttons: report goes at once, out of idle cycle
+				armPCINT();
+			#endif
 		}
     }
 }
\ No newline at end of file
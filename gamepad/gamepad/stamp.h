@@ -0,0 +1,45 @@
+#ifndef STAMP_H_
+#define STAMP_H_
+
+#include "defines.h"
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "usbdrv/usbdrv.h"
+#include "report.h"
+
+/*********************************************************************************/
+/* vendor fields of report (REPORT_STAMP): host gets sequence number of report,  */
+/* timer 1 cnt (free-running, US_TO_TICK) and SOF count at moment, when sample   */
+/* was latched from controller, so latency "latch -> USB frame" and lost or      */
+/* repeated reports are visible without logic analyzer                           */
+/* without REPORT_STAMP all calls are empty (STREAM, HISTORY take only time)     */
+/*********************************************************************************/
+
+typedef struct
+{
+	uint16_t time;
+	uchar sof;
+} stamp_t;
+
+static inline void stampTake(stamp_t *stamp) // call right when sample is latched
+{
+#if defined(REPORT_STAMP) || defined(STREAM) || defined(HISTORY)
+	stamp -> time = TCNT1;
+#endif
+#ifdef REPORT_STAMP
+	stamp -> sof = usbSofCount;
+#endif
+}
+
+static inline void stampReport(uchar *report, uchar seq, const stamp_t *stamp)
+{
+#ifdef REPORT_STAMP
+	reportSetSEQ(report, 0, seq);
+	reportSetTIME(report, 0, stamp -> time);
+	reportSetSOF(report, 0, stamp -> sof);
+#endif
+}
+
+#endif /* STAMP_H_ */
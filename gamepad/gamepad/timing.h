@@ -0,0 +1,127 @@
+#ifndef TIMING_H_
+#define TIMING_H_
+
+/************************************************************************************************************************/
+/* all timer constants are derived from F_CPU and durations in us from "defines.h", so firmware builds for any V-USB    */
+/* clock without recalculation by hand: timer prescaler is the smallest one, at which longest duration fits in timer,  */
+/* and every constant is checked on range and rounding error (TIMING_TOL_PCT)                                           */
+/************************************************************************************************************************/
+
+#if (F_CPU != 12000000L) && (F_CPU != 12800000L) && (F_CPU != 15000000L) && (F_CPU != 16000000L) && \
+	(F_CPU != 16500000L) && (F_CPU != 18000000L) && (F_CPU != 20000000L)
+	#error "F_CPU is not supported by V-USB: 12, 12.8, 15, 16, 16.5, 18, 20 MHz"
+#endif
+
+#define TIMING_TOL_PCT 5 /* max rounding error of timer constant, in % of duration */
+
+#define US_TO_CYC(us)			(((F_CPU / 1000L) * (us) + 500L) / 1000L) /* F_CPU / 1000 is exact for all V-USB clocks */
+#define US_TO_CNT(us, presc)	((US_TO_CYC(us) + (presc) / 2) / (presc))
+#define US_TO_CNT_MIN(us, presc)	((US_TO_CYC(us) + (presc) - 1) / (presc)) /* for minimum delays: round up, never shorter */
+
+#define TIMING_ABS(x)			((x) < 0 ? -(x) : (x))
+#define TIMING_ERR_OK(us, presc) \
+	(TIMING_ABS(US_TO_CNT(us, presc) * (presc) - US_TO_CYC(us)) * 100 <= TIMING_TOL_PCT * US_TO_CYC(us))
+#define TIMING_FITS(us, presc)	((US_TO_CNT(us, presc) >= 1) && (US_TO_CNT(us, presc) <= 256))
+
+/*********************************************************************************/
+/*        free-running timer 1 time base of all firmwares, see "sched.h"         */
+/*********************************************************************************/
+
+#define TICK_T1_PRESC	64
+#define TICK_T1_CS		((1 << CS11) | (1 << CS10))
+
+#define US_TO_TICK(us)	US_TO_CNT(us, TICK_T1_PRESC) /* 4 us at 16 MHz, 16 bit wrap ~ 262 ms */
+
+#if US_TO_TICK(PS_PROBE_US * (1L << PROBE_BACKOFF_MAX)) > 32767
+	#error "PS_PROBE_US << PROBE_BACKOFF_MAX must be less than half of timer 1 wrap"
+#endif
+
+#if !TIMING_ERR_OK(CLK_HALF_PER_US, TICK_T1_PRESC)
+	#error "CLK_HALF_PER_US does not fit timer 1 tick: psone_only.c CLK edges go in slot table"
+#endif
+
+/*********************************************************************************/
+/*      SEGA SEL slot on timer 1 tick (sega_only.c), "us" of config in ticks     */
+/*********************************************************************************/
+
+#define SEL_MAX_US		65535L	/* upper limit of config: 16 bit field */
+#define SEL_RESET		US_TO_CNT_MIN(SEL_RESET_US, TICK_T1_PRESC)	/* earliest packet after previous one */
+#define SEL_WAIT_STEP	US_TO_TICK(SEL_WAIT_STEP_US)
+
+#if US_TO_TICK(SEL_MAX_US) > 32767
+	#error "SEL_MAX_US must be less than half of timer 1 wrap"
+#endif
+
+#if !TIMING_ERR_OK(PER_POLL_GP_US, TICK_T1_PRESC) || !TIMING_ERR_OK(DELAY_BTW_POLL_US, TICK_T1_PRESC)
+	#error "PER_POLL_GP_US and DELAY_BTW_POLL_US do not fit timer 1 tick"
+#endif
+
+#if (SEL_WAIT_STEP < 1) || (SEL_WAIT_STEP_US >= SEL_RESET_US)
+	#error "SEL_WAIT_STEP_US must be from timer 1 tick to SEL_RESET_US"
+#endif
+
+#if DELAY_BEF_POLL_US >= PER_POLL_GP_MIN_US
+	#error "DELAY_BEF_POLL_US must be less than PER_POLL_GP_MIN_US"
+#endif
+
+#if PER_POLL_GP_US < PER_POLL_GP_MIN_US
+	#error "PER_POLL_GP_US: default config is out of its limits"
+#endif
+
+#if SEL_RESET_US >= DELAY_BTW_POLL_US
+	#error "SEL_RESET_US must be less than DELAY_BTW_POLL_US"
+#endif
+
+/*********************************************************************************/
+/*                           PS hardware SPI (main.c)                            */
+/*********************************************************************************/
+
+#if F_CPU / 2 <= PS_SCK_HZ
+	#define SPI_DIV_LOG2 1
+#elif F_CPU / 4 <= PS_SCK_HZ
+	#define SPI_DIV_LOG2 2
+#elif F_CPU / 8 <= PS_SCK_HZ
+	#define SPI_DIV_LOG2 3
+#elif F_CPU / 16 <= PS_SCK_HZ
+	#define SPI_DIV_LOG2 4
+#elif F_CPU / 32 <= PS_SCK_HZ
+	#define SPI_DIV_LOG2 5
+#elif F_CPU / 64 <= PS_SCK_HZ
+	#define SPI_DIV_LOG2 6
+#elif F_CPU / 128 <= PS_SCK_HZ
+	#define SPI_DIV_LOG2 7 /* SCK = F_CPU / 2^SPI_DIV_LOG2 (1..7): fastest not faster than PS_SCK_HZ */
+#else
+	#error "PS_SCK_HZ is less than F_CPU / 128"
+#endif
+
+#define PS_FRAME_US (PS_FRAME_MAX * 8L * (1L << SPI_DIV_LOG2) * 1000000L / F_CPU) /* longest frame on SCK, without gaps */
+
+#if PS_RETRY_MAX_US + PS_FRAME_US < STEP_IDLE_US
+	#define PS_RETRY_US	PS_RETRY_MAX_US
+#else
+	#define PS_RETRY_US	(STEP_IDLE_US - PS_FRAME_US - 1) /* multitap at 12, 12.8 MHz: last retry still ends in report step */
+#endif
+
+#if PS_RETRY_US < 1
+	#error "PS_FRAME_MAX: longest frame does not fit report step"
+#endif
+
+#define PS_FRAME_WCET_US	(PS_FRAME_MAX * 8L * 128L * 1000000L / F_CPU) /* slowest SCK of config ("spi_div_log2" = 7) */
+#define PS_POLL_WCET_US		(PS_RETRY_US + PS_FRAME_WCET_US + SCHED_BUILD_WCET_US) /* last retry starts before PS_RETRY_US is over */
+
+/*********************************************************************************/
+/*                       USART of binary trace (trace.c)                         */
+/*********************************************************************************/
+
+#define TRACE_UBRR (F_CPU / (8L * TRACE_BAUD_MIN) - 1) /* U2X: baud = F_CPU / (8 * (UBRR + 1)), round down: not below min */
+#define TRACE_BAUD (F_CPU / (8L * (TRACE_UBRR + 1))) /* exact rate of clock: 1 M at 16 MHz, 1.5 M at 12 MHz, 1.25 M at 20 MHz */
+
+#if (TRACE_UBRR < 0) || (TRACE_UBRR > 4095)
+	#error "TRACE_BAUD_MIN does not fit 12 bit UBRR"
+#endif
+
+#if TRACE_BAUD < 1000000L
+	#error "TRACE_BAUD: stream of frames needs 1 Mbaud or more"
+#endif
+
+#endif /* TIMING_H_ */
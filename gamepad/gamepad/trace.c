@@ -0,0 +1,128 @@
+#include "trace.h"
+
+#ifdef TRACE_USART
+
+#include <string.h>
+#include <util/crc16.h>
+
+trace_rec_t trace_buf[TRACE_RECORDS];
+
+volatile uchar trace_head = 0;
+volatile uchar trace_tail = 0;
+volatile uchar trace_lost = 0;
+volatile uchar trace_busy = 0;
+
+#ifdef STREAM
+	uchar stream_pkt[1 + STREAM_HDR + STREAM_DATA_MAX]; // id, header, data
+	uchar stream_len = 0; // bytes of packet in slot without crc
+	volatile uchar stream_state = STREAM_FREE;
+#endif
+
+typedef char trace_ring_check[((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0) ? 1 : -1]; // power of 2
+
+void traceInit() // TXD only, 8N1
+{
+	UBRR0 = TRACE_UBRR; // see "timing.h"
+	UCSR0A = (1 << U2X0);
+	UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+	UCSR0B = (1 << TXEN0);
+	
+	traceEvent(TRACE_ID_BOOT, MCUSR);
+}
+
+#ifdef STREAM
+void streamFrame(uchar id, const uchar *data, uchar len, uint16_t time) // main loop only, len <= STREAM_DATA_MAX
+{
+	static uchar seq = 0;
+	uchar sreg;
+	
+	seq++; // also for dropped frame: host sees gap
+	
+	if(stream_state != STREAM_FREE) return; // previous frame is still on wire: drop
+	
+	stream_pkt[0] = id;
+	stream_pkt[1] = seq;
+	stream_pkt[2] = time;
+	stream_pkt[3] = time >> 8;
+	memcpy(&stream_pkt[1 + STREAM_HDR], data, len);
+	stream_len = 1 + STREAM_HDR + len;
+	
+	sreg = SREG;
+	cli();
+	
+	stream_state = STREAM_PENDING;
+	if(!trace_busy) UCSR0B |= (1 << UDRIE0);
+	
+	SREG = sreg;
+}
+#endif
+
+ISR(USART_UDRE_vect) // one byte per interrupt: packet (stream frame or trace record), then its crc
+{
+	static const uchar *pkt;
+	static uchar len = 0; // bytes of packet without crc, 0 - next packet is not taken yet
+	static uchar pos = 0;
+	static uchar crc = 0;
+	uchar data, lost;
+	
+	UCSR0B &= ~(1 << UDRIE0); // "cli" for UDRE only: flag stays set while UDR0 is empty
+	trace_busy = 1;
+	sei();
+	
+	if(len == 0) // take next packet: frame goes before records, they wait in ring
+	{
+	#ifdef STREAM
+		if(stream_state == STREAM_PENDING)
+		{
+			stream_state = STREAM_SENDING;
+			pkt = stream_pkt;
+			len = stream_len;
+		}
+		else
+	#endif
+		{
+			pkt = (uchar *)&trace_buf[trace_tail];
+			len = sizeof(trace_rec_t);
+		}
+	}
+	
+	if(pos < len)
+	{
+		data = pkt[pos++];
+		crc = _crc_ibutton_update(crc, data);
+	}
+	else
+	{ // packet is sent:
+		data = crc;
+		crc = 0;
+		pos = 0;
+		len = 0;
+		
+	#ifdef STREAM
+		if(pkt == stream_pkt) stream_state = STREAM_FREE;
+		else
+	#endif
+		{
+			trace_tail = (trace_tail + 1) & (TRACE_RECORDS - 1);
+			
+			cli();
+			lost = trace_lost;
+			trace_lost = 0;
+			sei();
+			
+			if(lost) traceEvent(TRACE_ID_LOST, lost); // there is place for it at least now
+		}
+	}
+	
+	UDR0 = data;
+	
+	cli();
+	trace_busy = 0;
+	
+#ifdef STREAM
+	if(stream_state == STREAM_PENDING) UCSR0B |= (1 << UDRIE0);
+#endif
+	if((trace_tail != trace_head) | (len != 0)) UCSR0B |= (1 << UDRIE0);
+}
+
+#endif
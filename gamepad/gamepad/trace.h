@@ -0,0 +1,132 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "defines.h"
+
+#include <stdint.h>
+
+#ifndef uchar
+	#define uchar unsigned char
+#endif
+
+/*********************************************************************************/
+/* binary trace (TRACE): "traceEvent" puts 4 byte record in RAM ring, UDRE       */
+/* interrupt sends records on TXD at TRACE_BAUD, so logging does not wait for    */
+/* USART and costs ~ 20 cycles with interrupts off for ~ 15 (within V-USB 25)   */
+/* full ring: record is dropped, count of dropped goes later as TRACE_ID_LOST    */
+/*                                                                               */
+/* on wire:  id | payload | time LSB | time MSB | crc (iButton CRC-8 of 4 bytes) */
+/* "time" - timer 1 cnt (free-running, US_TO_TICK), host resyncs by crc          */
+/* decoder: "gamepad_test/trace_decode"                                          */
+/*                                                                               */
+/* stream (STREAM): "streamFrame" puts raw answer of controller in one frame     */
+/* slot, UDRE interrupt sends it between records as packet of the same format:  */
+/*		id (>= 0x80) | seq | time LSB | time MSB | data | crc                    */
+/* "seq" grows for every frame, also dropped one (slot was still on wire), so    */
+/* gap on host shows lost frame; "time" - timer 1 cnt when frame was latched     */
+/*********************************************************************************/
+
+// event id (< 0x80):
+	#define TRACE_ID_BOOT		0x01	/* payload: MCUSR, reset source */
+	#define TRACE_ID_LOST		0x02	/* payload: records dropped on full ring */
+	#define TRACE_ID_SETUP		0x03	/* payload: bRequest of class request */
+	#define TRACE_ID_POLL		0x10	/* payload: controller is present */
+	#define TRACE_ID_UNPLUG		0x11	/* payload: player, slot for multitap */
+	#define TRACE_ID_REPORT		0x12	/* payload: player, report goes to endpoint */
+	#define TRACE_ID_BAD_FRAME	0x13	/* payload: PS_FRAME_* of last retry, last good report is held */
+	#define TRACE_ID_SEL_END	0x20	/* payload: presence of SEGA ports, bit per port */
+
+#define TRACE_REC_DATA	3 /* bytes after id on wire without crc */
+
+// stream frame id (>= 0x80):
+	#define STREAM_ID_PS	0x80	/* data: 9 bytes of PS answer, see "ps_frame" */
+	#define STREAM_ID_SEGA	0x81	/* data: PIN of SEGA ports in SEL states 0..7, 1st then 2nd player */
+	#define STREAM_ID_PS_TAP	0x82	/* data: 35 bytes of PS answer with multitap */
+
+#define STREAM_HDR		3	/* seq, time LSB, time MSB */
+#define STREAM_PS_LEN	9
+#define STREAM_SEGA_LEN	16
+#define STREAM_PS_TAP_LEN	PS_TAP_FRAME_LEN
+
+#ifdef PS_MULTITAP
+	#define STREAM_DATA_MAX	STREAM_PS_TAP_LEN
+#else
+	#define STREAM_DATA_MAX	16
+#endif
+
+// state of frame slot:
+	#define STREAM_FREE		0
+	#define STREAM_PENDING	1	/* waits end of record which is on wire */
+	#define STREAM_SENDING	2
+
+typedef struct
+{
+	uchar id;
+	uchar payload;
+	uint16_t time;
+} trace_rec_t;
+
+#if defined(TRACE_USART) && !defined(FW_HOST)
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+extern trace_rec_t trace_buf[TRACE_RECORDS];
+extern volatile uchar trace_head; // next record to write
+extern volatile uchar trace_tail; // record is being sent
+extern volatile uchar trace_lost;
+extern volatile uchar trace_busy; // UDRE ISR works with interrupts on: must not be enabled again from nested ISR
+
+void traceInit();
+
+static inline void traceEvent(uchar id, uchar payload) // main loop and ISR
+{
+	uchar sreg = SREG;
+	uchar head, next;
+	
+	cli();
+	
+	head = trace_head;
+	next = (head + 1) & (TRACE_RECORDS - 1);
+	
+	if(next != trace_tail)
+	{
+		trace_rec_t *rec = &trace_buf[head];
+		
+		rec -> id = id;
+		rec -> payload = payload;
+		rec -> time = TCNT1;
+		
+		trace_head = next;
+		if(!trace_busy) UCSR0B |= (1 << UDRIE0);
+	}
+	else if(trace_lost != 0xFF) trace_lost++; // saturates: count goes to host in next record
+	
+	SREG = sreg;
+}
+
+#ifdef TRACE
+	#define TRACE_EVENT(id, payload) traceEvent(id, payload)
+#else
+	#define TRACE_EVENT(id, payload)
+#endif
+
+#ifdef STREAM
+	extern uchar stream_pkt[1 + STREAM_HDR + STREAM_DATA_MAX];
+	extern volatile uchar stream_state;
+	
+	void streamFrame(uchar id, const uchar *data, uchar len, uint16_t time);
+	
+	#define STREAM_FRAME(id, data, len, time) streamFrame(id, data, len, time)
+#else
+	#define STREAM_FRAME(id, data, len, time)
+#endif
+
+#else
+
+#define TRACE_EVENT(id, payload)
+#define STREAM_FRAME(id, data, len, time)
+
+#endif
+
+#endif /* TRACE_H_ */
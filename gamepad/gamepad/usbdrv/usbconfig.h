@@ -81,7 +81,7 @@ section at the end of this file).
  * default control endpoint 0 and an interrupt-in endpoint (any other endpoint
  * number).
  */
-#define USB_CFG_HAVE_INTRIN_ENDPOINT3   0
+#define USB_CFG_HAVE_INTRIN_ENDPOINT3   1
 /* Define this to 1 if you want to compile a version with three endpoints: The
  * default control endpoint 0, an interrupt-in endpoint 3 (or the number
  * configured below) and a catch-all default interrupt-in endpoint as above.
@@ -125,12 +125,12 @@ section at the end of this file).
  * The value is in milliamperes. [It will be divided by two since USB
  * communicates power requirements in units of 2 mA.]
  */
-#define USB_CFG_IMPLEMENT_FN_WRITE      0
+#define USB_CFG_IMPLEMENT_FN_WRITE      1
 /* Set this to 1 if you want usbFunctionWrite() to be called for control-out
  * transfers. Set it to 0 if you don't need it and want to save a couple of
  * bytes.
  */
-#define USB_CFG_IMPLEMENT_FN_READ       0
+#define USB_CFG_IMPLEMENT_FN_READ       1
 /* Set this to 1 if you need to send control replies which are generated
  * "on the fly" when usbFunctionRead() is called. If you only want to send
  * data from a static buffer, set it to 0 and return the data from
@@ -142,7 +142,11 @@ section at the end of this file).
  * interrupt/bulk data sent to any endpoint other than 0. The endpoint number
  * can be found in 'usbRxToken'.
  */
-#define USB_CFG_HAVE_FLOWCONTROL        0
+#ifdef PS_MEMCARD
+	#define USB_CFG_HAVE_FLOWCONTROL    1 /* sectors to memory card: host gets NAK while card takes buffer */
+#else
+	#define USB_CFG_HAVE_FLOWCONTROL    0
+#endif
 /* Define this to 1 if you want flowcontrol over USB data. See the definition
  * of the macros usbDisableAllRequests() and usbEnableAllRequests() in
  * usbdrv.h.
@@ -152,7 +156,11 @@ section at the end of this file).
  * where the driver's constants (descriptors) are located. Or in other words:
  * Define this to 1 for boot loaders on the ATMega128.
  */
-#define USB_CFG_LONG_TRANSFERS          0
+#ifdef PS_MEMCARD
+	#define USB_CFG_LONG_TRANSFERS      1 /* sectors of memory card */
+#else
+	#define USB_CFG_LONG_TRANSFERS      0
+#endif
 /* Define this to 1 if you want to send/receive blocks of more than 254 bytes
  * in a single control-in or control-out transfer. Note that the capability
  * for long transfers increases the driver size.
@@ -173,7 +181,11 @@ section at the end of this file).
 /* This macro (if defined) is executed when a USB SET_ADDRESS request was
  * received.
  */
-#define USB_COUNT_SOF                   0
+#ifdef REPORT_STAMP
+	#define USB_COUNT_SOF               1 /* SOF count goes to report: interrupt is moved on D- (INT1), see end of file */
+#else
+	#define USB_COUNT_SOF               0
+#endif
 /* define this macro to 1 if you need the global variable "usbSofCount" which
  * counts SOF packets. This feature requires that the hardware interrupt is
  * connected to D- instead of D+.
@@ -288,7 +300,7 @@ section at the end of this file).
  * CDC class is 2, use subclass 2 and protocol 1 for ACM
  */
 
-#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    47 /* total length of report descriptor */
+#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    REPORT_DESCR_LEN /* generated from field table, see "report_fields.h" */
 
 /* Define this to the length of the HID report descriptor, if you implement
  * an HID device. Otherwise don't define it or define it to 0.
@@ -362,7 +374,11 @@ section at the end of this file).
 #define USB_CFG_DESCR_PROPS_STRING_PRODUCT          USB_PROP_IS_DYNAMIC
 #define USB_CFG_DESCR_PROPS_STRING_SERIAL_NUMBER    0 // ???
 #define USB_CFG_DESCR_PROPS_HID                     0
-#define USB_CFG_DESCR_PROPS_HID_REPORT              0
+#ifdef PS_MOUSE
+	#define USB_CFG_DESCR_PROPS_HID_REPORT          USB_PROP_IS_DYNAMIC /* gamepad or mouse by interface */
+#else
+	#define USB_CFG_DESCR_PROPS_HID_REPORT          0
+#endif
 #define USB_CFG_DESCR_PROPS_UNKNOWN                 0
 
 
@@ -391,4 +407,15 @@ section at the end of this file).
 /* #define USB_INTR_PENDING_BIT    INTF0 */
 /* #define USB_INTR_VECTOR         INT0_vect */
 
+#if USB_COUNT_SOF /* SOF is seen only on D-: PD3 <=> INT1 */
+	#define USB_INTR_CFG            EICRA
+	#define USB_INTR_CFG_SET        ((1 << ISC10) | (1 << ISC11))
+	#define USB_INTR_CFG_CLR        0
+	#define USB_INTR_ENABLE         EIMSK
+	#define USB_INTR_ENABLE_BIT     INT1
+	#define USB_INTR_PENDING        EIFR
+	#define USB_INTR_PENDING_BIT    INTF1
+	#define USB_INTR_VECTOR         INT1_vect
+#endif
+
 #endif /* __usbconfig_h_included__ */
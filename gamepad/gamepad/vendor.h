@@ -0,0 +1,21 @@
+#ifndef VENDOR_H_
+#define VENDOR_H_
+
+/*********************************************************************************/
+/* vendor requests to device (bmRequestType 0xC0 - IN, 0x40 - OUT), answered in  */
+/* "usbFunctionSetup" besides HID class requests; libusb on host can send them   */
+/* without driver for HID interfaces                                             */
+/*********************************************************************************/
+
+#define VENDOR_RQ_PS_ERRORS	0x01 /* IN: "ps_errors_t" (see "report.h"), wValue = 1 - reset counters after read */
+
+// PS memory card (PS_MEMCARD, see "memcard.h"): wValue - first sector, wLength - 128 * sectors
+	#define VENDOR_RQ_MC_READ	0x02 /* IN: sectors, short transfer - error */
+	#define VENDOR_RQ_MC_WRITE	0x03 /* OUT: sectors, stall - error */
+	#define VENDOR_RQ_MC_STATUS	0x04 /* IN: "mc_status_t" of last transfer */
+
+#define VENDOR_RQ_HISTORY	0x05 /* IN: "hist_head_t", then "hist_rec_t" from oldest (HISTORY, see "history.h") */
+#define VENDOR_RQ_POLL_NOW	0x06 /* OUT, no data: controller poll at once, reports of all players go to endpoints */
+									/* out of idle cycle, so host samples right before its frame (main.c) */
+
+#endif /* VENDOR_H_ */